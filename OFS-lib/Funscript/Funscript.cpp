@@ -6,10 +6,13 @@
 #include "OFS_EventSystem.h"
 #include "OFS_Serialization.h"
 #include "FunscriptUndoSystem.h"
+#include "FunscriptActionKernels.h"
+#include "FunscriptParser.h"
 
 #include "state/states/ChapterState.h"
 
 #include <algorithm>
+#include <cstring>
 #include <limits>
 
 std::array<const char*, 9> Funscript::AxisNames = 
@@ -49,8 +52,16 @@ void Funscript::saveMetadata(nlohmann::json& outMetadataObj, const Funscript::Me
 }
 
 void Funscript::notifyActionsChanged(bool isEdit) noexcept
+{
+	notifyActionsChanged(isEdit, std::numeric_limits<float>::lowest(), std::numeric_limits<float>::max());
+}
+
+void Funscript::notifyActionsChanged(bool isEdit, float fromTime, float toTime) noexcept
 {
 	funscriptChanged = true;
+	revision += 1;
+	changedFrom = std::min(changedFrom, fromTime);
+	changedTo = std::max(changedTo, toTime);
 	if (isEdit && !unsavedEdits) {
 		unsavedEdits = true;
 		editTime = std::chrono::system_clock::now();
@@ -62,7 +73,9 @@ void Funscript::Update() noexcept
 	OFS_PROFILE(__FUNCTION__);
 	if (funscriptChanged) {
 		funscriptChanged = false;
-		EV::Enqueue<FunscriptActionsChangedEvent>(this);
+		EV::Enqueue<FunscriptActionsChangedEvent>(this, changedFrom, changedTo);
+		changedFrom = std::numeric_limits<float>::max();
+		changedTo = std::numeric_limits<float>::lowest();
 	}
 	if (selectionChanged) {
 		selectionChanged = false;
@@ -76,43 +89,46 @@ float Funscript::GetPositionAtTime(float time) const noexcept
 	if (data.Actions.size() == 0) {	return 0; } 
 	else if (data.Actions.size() == 1) return data.Actions[0].pos;
 
-	int i = 0;
+	// before the first and after the last action this has always returned the last position
 	auto it = data.Actions.lower_bound(FunscriptAction(time, 0));
-	if (it != data.Actions.end()) {
-		i = std::distance(data.Actions.begin(), it);
-		if (i > 0) --i;
+	if (it == data.Actions.end() || it == data.Actions.begin()) {
+		return it == data.Actions.begin() && it->atS == time ? it->pos : data.Actions.back().pos;
+	}
+	else if (it->atS == time) {
+		return it->pos;
 	}
 
-	for (; i < data.Actions.size()-1; i++) {
-		auto& action = data.Actions[i];
-		auto& next = data.Actions[i + 1];
+	// interpolate position
+	auto& action = *(it - 1);
+	auto& next = *it;
+	int32_t lastPos = action.pos;
+	float diff = next.pos - action.pos;
+	float progress = (float)(time - action.atS) / (next.atS - action.atS);
 
-		if (time > action.atS && time < next.atS) {
-			// interpolate position
-			int32_t lastPos = action.pos;
-			float diff = next.pos - action.pos;
-			float progress = (float)(time - action.atS) / (next.atS - action.atS);
-			
-			float interp = lastPos + (progress * (float)diff);
-			return interp;
-		}
-		else if (action.atS == time) {
-			return action.pos;
-		}
-	}
+	float interp = lastPos + (progress * (float)diff);
+	return interp;
+}
 
-	return data.Actions.back().pos;
+void Funscript::SampleRange(float startTime, float stepTime, size_t count, float* outPositions) const noexcept
+{
+	OFS_PROFILE(__FUNCTION__);
+	if (count == 0) return;
+	if (data.Actions.empty()) {
+		std::fill_n(outPositions, count, 0.f);
+		return;
+	}
+	FunscriptActionSoA soa;
+	soa.LoadRange(data.Actions, startTime, startTime + (float)(count - 1) * stepTime, 0);
+	float lastPos = data.Actions.back().pos;
+	FunscriptActionKernels::SampleLinear(soa, startTime, stepTime, outPositions, count, lastPos, lastPos);
 }
 
 void Funscript::AddMultipleActions(const FunscriptArray& actions) noexcept
 {
 	OFS_PROFILE(__FUNCTION__);
-	for(auto& action : actions)
-	{
-		data.Actions.emplace(action);
-	}
-	sortActions(data.Actions);
-	notifyActionsChanged(true);
+	if (actions.empty()) return;
+	data.Actions.merge(actions.begin(), actions.end());
+	notifyActionsChanged(true, actions.front().atS, actions.back().atS);
 }
 
 
@@ -125,7 +141,7 @@ bool Funscript::EditAction(FunscriptAction oldAction, FunscriptAction newAction)
 		act->atS = newAction.atS;
 		act->pos = newAction.pos;
 		checkForInvalidatedActions();
-		notifyActionsChanged(true);
+		notifyActionsChanged(true, std::min(oldAction.atS, newAction.atS), std::max(oldAction.atS, newAction.atS));
 		sortActions(data.Actions);
 		return true;
 	}
@@ -137,8 +153,8 @@ void Funscript::AddEditAction(FunscriptAction action, float frameTime) noexcept
 	OFS_PROFILE(__FUNCTION__);
 	auto close = getActionAtTime(data.Actions, action.atS, frameTime);
 	if (close != nullptr) {
+		notifyActionsChanged(true, std::min(close->atS, action.atS), std::max(close->atS, action.atS));
 		*close = action;
-		notifyActionsChanged(true);
 		checkForInvalidatedActions();
 	}
 	else {
@@ -167,25 +183,41 @@ void Funscript::RemoveAction(FunscriptAction action, bool checkInvalidSelection)
 	auto it = data.Actions.find(action);
 	if (it != data.Actions.end()) {
 		data.Actions.erase(it);
-		notifyActionsChanged(true);
+		notifyActionsChanged(true, action.atS, action.atS);
 
 		if (checkInvalidSelection) { checkForInvalidatedActions(); }
 	}
 }
 
-void Funscript::RemoveActions(const FunscriptArray& removeActions) noexcept
+void Funscript::removeSortedActions(FunscriptArray& actions, const FunscriptArray& remove, FunscriptArray* outRemoved) noexcept
 {
 	OFS_PROFILE(__FUNCTION__);
-	auto it = std::remove_if(data.Actions.begin(), data.Actions.end(),
-		[&removeActions, end = removeActions.end()](auto action) {
-			if (removeActions.find(action) != end) {
+	if (remove.empty()) return;
+	// both arrays are sorted so a single erase-remove pass with a cursor is enough
+	auto removeIt = remove.begin();
+	auto removeEnd = remove.end();
+	auto it = std::remove_if(actions.begin(), actions.end(),
+		[&removeIt, removeEnd, outRemoved](auto action) noexcept {
+			while (removeIt != removeEnd && removeIt->atS < action.atS) {
+				++removeIt;
+			}
+			if (removeIt != removeEnd && *removeIt == action) {
+				if (outRemoved) outRemoved->emplace_back_unsorted(action);
+				++removeIt;
 				return true;
 			}
 			return false;
 		});
-	data.Actions.erase(it, data.Actions.end());
+	actions.erase(it, actions.end());
+}
 
-	notifyActionsChanged(true);
+void Funscript::RemoveActions(const FunscriptArray& removeActions) noexcept
+{
+	OFS_PROFILE(__FUNCTION__);
+	if (removeActions.empty()) return;
+	removeSortedActions(data.Actions, removeActions);
+
+	notifyActionsChanged(true, removeActions.front().atS, removeActions.back().atS);
 	checkForInvalidatedActions();
 }
 
@@ -249,17 +281,22 @@ void Funscript::SetActions(const FunscriptArray& override_with) noexcept
 	notifyActionsChanged(true);
 }
 
+void Funscript::SetActions(FunscriptArray&& override_with) noexcept
+{
+	OFS_PROFILE(__FUNCTION__);
+	data.Actions = std::move(override_with);
+	notifyActionsChanged(true);
+}
+
 void Funscript::RemoveActionsInInterval(float fromTime, float toTime) noexcept
 {
 	OFS_PROFILE(__FUNCTION__);
-	data.Actions.erase(
-		std::remove_if(data.Actions.begin(), data.Actions.end(),
-			[fromTime, toTime](auto action) {
-				return action.atS >= fromTime && action.atS <= toTime;
-			}), data.Actions.end()
-	);
+	if (fromTime > toTime) return;
+	auto first = data.Actions.lower_bound(FunscriptAction(fromTime, 0));
+	auto last = data.Actions.upper_bound(FunscriptAction(toTime, 0));
+	data.Actions.erase(first, last);
 	checkForInvalidatedActions();
-	notifyActionsChanged(true);
+	notifyActionsChanged(true, fromTime, toTime);
 }
 
 void Funscript::RangeExtendSelection(int32_t rangeExtend) noexcept
@@ -512,13 +549,13 @@ void Funscript::RemoveSelectedActions() noexcept
 		// assume data.selection == data.Actions
 		// aslong as we don't fuck up the selection this is safe 
 		data.Actions.clear();
+		notifyActionsChanged(true);
 	}
 	else {
 		RemoveActions(data.Selection);
 	}
 
 	ClearSelection();
-	notifyActionsChanged(true);
 	notifySelectionChanged();
 }
 
@@ -526,20 +563,7 @@ void Funscript::moveAllActionsTime(float timeOffset)
 {
 	OFS_PROFILE(__FUNCTION__);
 	ClearSelection();
-	for (auto& move : data.Actions) {
-		move.atS += timeOffset;
-	}
-	notifyActionsChanged(true);
-}
-
-void Funscript::moveActionsPosition(std::vector<FunscriptAction*> moving, int32_t posOffset)
-{
-	OFS_PROFILE(__FUNCTION__);
-	ClearSelection();
-	for (auto move : moving) {
-		move->pos += posOffset;
-		move->pos = Util::Clamp<int16_t>(move->pos, 0, 100);
-	}
+	FunscriptActionKernels::OffsetTime(data.Actions, timeOffset);
 	notifyActionsChanged(true);
 }
 
@@ -574,21 +598,18 @@ void Funscript::MoveSelectionTime(float timeOffset, float frameTime) noexcept
 		}
 	}
 
+	// remove the whole selection in one pass and merge the moved actions back in
 	FunscriptArray newSelection;
 	newSelection.reserve(data.Selection.size());
-	for (auto selected : data.Selection) {
-		auto move = getAction(selected);
-		if (move) {
-			FunscriptAction newAction = *move;
-			newAction.atS += timeOffset;
-			newSelection.emplace(newAction);
-			RemoveAction(*move, false);
-			AddAction(newAction);
-		}
-	}
+	removeSortedActions(data.Actions, data.Selection, &newSelection);
+	FunscriptActionKernels::OffsetTime(newSelection, timeOffset);
+	data.Actions.merge(newSelection.begin(), newSelection.end());
+	notifyActionsChanged(true,
+		data.Selection.front().atS + std::min(0.f, timeOffset),
+		data.Selection.back().atS + std::max(0.f, timeOffset));
+
 	ClearSelection();
 	data.Selection = std::move(newSelection);
-	notifyActionsChanged(true);
 }
 
 void Funscript::MoveSelectionPosition(int32_t pos_offset) noexcept
@@ -599,9 +620,9 @@ void Funscript::MoveSelectionPosition(int32_t pos_offset) noexcept
 	
 	// faster path when everything is selected
 	if (data.Selection.size() == data.Actions.size()) {
-		for (auto& action : data.Actions)
-			moving.push_back(&action);
-		moveActionsPosition(moving, pos_offset);
+		ClearSelection();
+		FunscriptActionKernels::OffsetPosition(data.Actions, pos_offset);
+		notifyActionsChanged(true);
 		SelectAll();
 		return;
 	}
@@ -612,6 +633,7 @@ void Funscript::MoveSelectionPosition(int32_t pos_offset) noexcept
 			moving.push_back(m);
 	}
 
+	notifyActionsChanged(true, data.Selection.front().atS, data.Selection.back().atS);
 	ClearSelection();
 	for (auto move : moving) {
 		move->pos += pos_offset;
@@ -619,16 +641,13 @@ void Funscript::MoveSelectionPosition(int32_t pos_offset) noexcept
 		data.Selection.emplace_back_unsorted(*move);
 	}
 	sortSelection();
-	notifyActionsChanged(true);
 }
 
 void Funscript::SetSelection(const FunscriptArray& actionsToSelect) noexcept
 {
 	OFS_PROFILE(__FUNCTION__);
 	ClearSelection();
-	for(auto& action : actionsToSelect) {
-		data.Selection.emplace(action);
-	}
+	data.Selection.merge(actionsToSelect.begin(), actionsToSelect.end());
 	notifySelectionChanged();
 }
 
@@ -652,14 +671,15 @@ void Funscript::EqualizeSelection() noexcept
 	auto copySelection = data.Selection;
 	RemoveSelectedActions(); // clears selection
 
-	for (int i = 1; i < copySelection.size()-1; i++) {
-		auto& newAction = copySelection[i];
-		newAction.atS = first.atS + i * stepTime;
+	int i = 0;
+	for (auto& newAction : copySelection) {
+		if (i > 0 && i < copySelection.size()-1) {
+			newAction.atS = first.atS + i * stepTime;
+		}
+		++i;
 	}
 
-	for (auto& action : copySelection)
-		AddAction(action);
-
+	AddMultipleActions(copySelection);
 	data.Selection = std::move(copySelection);
 }
 
@@ -669,16 +689,15 @@ void Funscript::InvertSelection() noexcept
 	if (data.Selection.empty()) return;
 	auto copySelection = data.Selection;
 	RemoveSelectedActions();
-	for (auto& act : copySelection)	{
-		act.pos = std::abs(act.pos - 100);
-		AddAction(act);
-	}
-	data.Selection = copySelection;
+	FunscriptActionKernels::InvertPosition(copySelection);
+	AddMultipleActions(copySelection);
+	data.Selection = std::move(copySelection);
 }
 
 void Funscript::UpdateRelativePath(const std::string& path) noexcept
 {
 	currentPathRelative = path;
+	revision += 1;
 
 	if(!title.empty())
 	{
@@ -711,6 +730,44 @@ bool Funscript::Deserialize(const nlohmann::json& json, Funscript::Metadata* out
 		}
 	}
 
+	deserializeMetadata(json, outMetadata, loadChapters);
+	notifyActionsChanged(false);
+	return true;
+}
+
+bool Funscript::Deserialize(const std::string& jsonText, Funscript::Metadata* outMetadata, bool loadChapters) noexcept
+{
+	OFS_PROFILE(__FUNCTION__);
+	std::vector<FunscriptAction> actions;
+	std::string remainder;
+	bool succ = false;
+	if (!FunscriptParser::ParseActions(jsonText.data(), jsonText.size(), actions, remainder)) {
+		// anything unusual goes through nlohmann::json
+		auto json = Util::ParseJson(jsonText, &succ);
+		return succ && Deserialize(json, outMetadata, loadChapters);
+	}
+
+	auto json = Util::ParseJson(remainder, &succ);
+	if (!succ) {
+		LOG_ERROR("Failed to load Funscript. Invalid json.");
+		return false;
+	}
+
+	// scripts are almost always sorted, stable_sort keeps the first of equal times like emplace does
+	if (!std::is_sorted(actions.begin(), actions.end(), ActionLess())) {
+		std::stable_sort(actions.begin(), actions.end(), ActionLess());
+	}
+	data.Actions.clear();
+	data.Actions.merge(actions.begin(), actions.end());
+
+	deserializeMetadata(json, outMetadata, loadChapters);
+	notifyActionsChanged(false);
+	return true;
+}
+
+void Funscript::deserializeMetadata(const nlohmann::json& json, Funscript::Metadata* outMetadata, bool loadChapters) noexcept
+{
+	OFS_PROFILE(__FUNCTION__);
 	if(outMetadata)
 	{
 		if(json.contains("metadata"))
@@ -805,12 +862,9 @@ bool Funscript::Deserialize(const nlohmann::json& json, Funscript::Metadata* out
 			}
 		}
 	}
-
-	notifyActionsChanged(false);
-	return true;
 }
 
-void Funscript::Serialize(nlohmann::json& json, const FunscriptData& funscriptData, const Funscript::Metadata& metadata, bool includeChapters) noexcept
+void Funscript::serializeWithoutActions(nlohmann::json& json, const Funscript::Metadata& metadata, bool includeChapters) noexcept
 {
 	OFS_PROFILE(__FUNCTION__);
 	json = nlohmann::json::object();
@@ -853,6 +907,12 @@ void Funscript::Serialize(nlohmann::json& json, const FunscriptData& funscriptDa
 			jsonMetadata["chapters"] = std::move(jsonChapters);
 		}
 	}
+}
+
+void Funscript::Serialize(nlohmann::json& json, const FunscriptData& funscriptData, const Funscript::Metadata& metadata, bool includeChapters) noexcept
+{
+	OFS_PROFILE(__FUNCTION__);
+	serializeWithoutActions(json, metadata, includeChapters);
 
 	auto& jsonActions = json["actions"];
 	jsonActions.clear();
@@ -878,4 +938,81 @@ void Funscript::Serialize(nlohmann::json& json, const FunscriptData& funscriptDa
 			LOG_WARN("Action was ignored since it had the same millisecond timestamp as the previous one.");
 		}
 	}
-}
\ No newline at end of file
+}
+
+// positive integers only
+inline static char* writeInteger(char* out, int64_t value) noexcept
+{
+	char digits[20];
+	int count = 0;
+	do {
+		digits[count++] = '0' + (char)(value % 10);
+		value /= 10;
+	} while (value > 0);
+	while (count > 0) *out++ = digits[--count];
+	return out;
+}
+
+// writes the actions like nlohmann::json dumps the array built in Serialize
+static void writeActions(std::string& out, const FunscriptArray& actions) noexcept
+{
+	OFS_PROFILE(__FUNCTION__);
+	// {"at":<19 digits>,"pos":100},
+	constexpr size_t MaxActionLength = 40;
+	size_t start = out.size();
+	out.resize(start + actions.size() * MaxActionLength);
+	char* begin = &out[start];
+	char* cur = begin;
+
+	int64_t lastTimestamp = -1;
+	for (auto action : actions) {
+		// a little validation just in case
+		if (action.atS < 0.f)
+			continue;
+
+		int64_t ts = (int64_t)std::round(action.atS*1000.0);
+		// make sure timestamps are unique
+		if (ts != lastTimestamp) {
+			if (cur != begin) *cur++ = ',';
+			std::memcpy(cur, "{\"at\":", 6); cur += 6;
+			cur = writeInteger(cur, ts);
+			std::memcpy(cur, ",\"pos\":", 7); cur += 7;
+			cur = writeInteger(cur, Util::Clamp<int32_t>(action.pos, 0, 100));
+			*cur++ = '}';
+			lastTimestamp = ts;
+		}
+		else
+		{
+			LOG_WARN("Action was ignored since it had the same millisecond timestamp as the previous one.");
+		}
+	}
+	out.resize(start + (cur - begin));
+}
+
+void Funscript::InsertActions(std::string& jsonText, const FunscriptArray& actions) noexcept
+{
+	OFS_PROFILE(__FUNCTION__);
+	constexpr const char Placeholder[] = "\"actions\":[]";
+	auto placeholderPos = jsonText.find(Placeholder);
+	FUN_ASSERT(placeholderPos != std::string::npos, "no empty actions array");
+	if (placeholderPos == std::string::npos) return;
+	// right before the ]
+	size_t insertPos = placeholderPos + sizeof(Placeholder) - 2;
+
+	std::string result;
+	result.reserve(jsonText.size() + actions.size() * 24);
+	result.append(jsonText, 0, insertPos);
+	writeActions(result, actions);
+	result.append(jsonText, insertPos, std::string::npos);
+	jsonText = std::move(result);
+}
+
+std::string Funscript::SerializeText(const FunscriptData& funscriptData, const Funscript::Metadata& metadata, bool includeChapters) noexcept
+{
+	OFS_PROFILE(__FUNCTION__);
+	nlohmann::json json;
+	serializeWithoutActions(json, metadata, includeChapters);
+	auto jsonText = Util::SerializeJson(json, false);
+	InsertActions(jsonText, funscriptData.Actions);
+	return jsonText;
+}
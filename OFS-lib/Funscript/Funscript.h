@@ -9,6 +9,7 @@
 #include <string>
 #include <memory>
 #include <chrono>
+#include <limits>
 
 #include "OFS_Util.h"
 #include "FunscriptSpline.h"
@@ -25,8 +26,13 @@ class FunscriptActionsChangedEvent : public OFS_Event<FunscriptActionsChangedEve
 	public:
 	// FIXME: get rid of this raw pointer
 	const Funscript* Script = nullptr;
+	// only actions in this time range were changed
+	float ChangedFrom = std::numeric_limits<float>::lowest();
+	float ChangedTo = std::numeric_limits<float>::max();
 	FunscriptActionsChangedEvent(const Funscript* changedScript) noexcept
 		: Script(changedScript) {}
+	FunscriptActionsChangedEvent(const Funscript* changedScript, float changedFrom, float changedTo) noexcept
+		: Script(changedScript), ChangedFrom(changedFrom), ChangedTo(changedTo) {}
 };
 
 class FunscriptSelectionChangedEvent : public OFS_Event<FunscriptSelectionChangedEvent>
@@ -85,20 +91,54 @@ public:
 	{
 		s.ext(*this, bitsery::ext::Growable{},
 			[](S& s, Funscript& o) {
-				s.container(o.data.Actions, std::numeric_limits<uint32_t>::max());
+				// older projects stored the actions here, it's written empty now
+				// and the actions follow in OFS_ActionEncoding at the end
+				FunscriptArray legacyActions;
+				s.container(legacyActions, std::numeric_limits<uint32_t>::max());
 				s.text1b(o.currentPathRelative, o.currentPathRelative.max_size());
 				s.text1b(o.title, o.title.max_size());
 				s.boolValue(o.Enabled);
+				s.ext(o.data.Actions, bitsery::ext::CompactActions{});
+				if (!legacyActions.empty()) o.data.Actions = std::move(legacyActions);
 			});
 	}
 
+	// Copy of everything serialize writes, so a project can be saved on another thread.
+	struct ProjectSnapshot {
+		FunscriptArray Actions;
+		std::string RelativePath;
+		std::string Title;
+		bool Enabled = true;
+
+		// must match Funscript::serialize
+		template<typename S>
+		void serialize(S& s)
+		{
+			s.ext(*this, bitsery::ext::Growable{},
+				[](S& s, ProjectSnapshot& o) {
+					FunscriptArray legacyActions;
+					s.container(legacyActions, std::numeric_limits<uint32_t>::max());
+					s.text1b(o.RelativePath, o.RelativePath.max_size());
+					s.text1b(o.Title, o.Title.max_size());
+					s.boolValue(o.Enabled);
+					s.ext(o.Actions, bitsery::ext::CompactActions{});
+					if (!legacyActions.empty()) o.Actions = std::move(legacyActions);
+				});
+		}
+	};
+	inline ProjectSnapshot MakeProjectSnapshot() const noexcept { return ProjectSnapshot{ data.Actions, currentPathRelative, title, Enabled }; }
+
 private:
 	// FIXME: OFS should be able to retain metadata injected by other programs without overwriting it
 	//nlohmann::json JsonOther;
 
 	std::chrono::system_clock::time_point editTime;
 	bool funscriptChanged = false; // used to fire only one event every frame a change occurs
+	// time range touched by edits since the last FunscriptActionsChangedEvent
+	float changedFrom = std::numeric_limits<float>::max();
+	float changedTo = std::numeric_limits<float>::lowest();
 	bool unsavedEdits = false; // used to track if the script has unsaved changes
+	uint32_t revision = 0; // bumped on every change to the saved data, used by journaled project saves
 	bool selectionChanged = false;
 	FunscriptData data;
 
@@ -170,17 +210,24 @@ private:
 		return nullptr;
 	}
 
+	static void removeSortedActions(FunscriptArray& actions, const FunscriptArray& remove, FunscriptArray* outRemoved = nullptr) noexcept;
+
 	void moveAllActionsTime(float timeOffset);
-	void moveActionsPosition(std::vector<FunscriptAction*> moving, int32_t posOffset);
 	inline void sortSelection() noexcept { sortActions(data.Selection); }
-	inline void sortActions(FunscriptArray& actions) noexcept { std::sort(actions.begin(), actions.end()); }
-	inline void addAction(FunscriptArray& actions, FunscriptAction newAction) noexcept { actions.emplace(newAction); notifyActionsChanged(true); }
+	inline void sortActions(FunscriptArray& actions) noexcept { actions.sort(); }
+	inline void addAction(FunscriptArray& actions, FunscriptAction newAction) noexcept { actions.emplace(newAction); notifyActionsChanged(true, newAction.atS, newAction.atS); }
 	inline void notifySelectionChanged() noexcept { selectionChanged = true; }
 
 	static void loadMetadata(const nlohmann::json& metadataObj, Funscript::Metadata& outMetadata) noexcept;
+	void deserializeMetadata(const nlohmann::json& json, Funscript::Metadata* outMetadata, bool loadChapters) noexcept;
+	// everything except the actions, those are left as an empty array
+	static void serializeWithoutActions(nlohmann::json& json, const Funscript::Metadata& metadata, bool includeChapters) noexcept;
 	static void saveMetadata(nlohmann::json& outMetadataObj, const Funscript::Metadata& inMetadata) noexcept;
 
+	// marks the whole script as changed
 	void notifyActionsChanged(bool isEdit) noexcept; 
+	// only actions between fromTime and toTime changed
+	void notifyActionsChanged(bool isEdit, float fromTime, float toTime) noexcept;
 	std::string currentPathRelative;
 	std::string title;
 public:
@@ -202,6 +249,8 @@ public:
 	void Update() noexcept;
 
 	bool Deserialize(const nlohmann::json& json, Funscript::Metadata* outMetadata, bool loadChapters) noexcept;
+	// parses the actions without building a json DOM for them, prefer this over the json overload
+	bool Deserialize(const std::string& jsonText, Funscript::Metadata* outMetadata, bool loadChapters) noexcept;
 	inline nlohmann::json Serialize(const Funscript::Metadata& metadata, bool includeChapters) const noexcept 
 	{ 
 		nlohmann::json json;
@@ -209,6 +258,14 @@ public:
 		return json;
 	}
 	static void Serialize(nlohmann::json& json, const FunscriptData& funscriptData, const Funscript::Metadata& metadata, bool includeChapters) noexcept;
+	// same text as Util::SerializeJson(Serialize(...)) without a json node per action
+	static std::string SerializeText(const FunscriptData& funscriptData, const Funscript::Metadata& metadata, bool includeChapters) noexcept;
+	inline std::string SerializeText(const Funscript::Metadata& metadata, bool includeChapters) const noexcept
+	{
+		return SerializeText(data, metadata, includeChapters);
+	}
+	// writes the actions into the first "actions":[] of a compact json text
+	static void InsertActions(std::string& jsonText, const FunscriptArray& actions) noexcept;
 	
 	inline const FunscriptData& Data() const noexcept { return data; }
 	inline const auto& Selection() const noexcept { return data.Selection; }
@@ -221,8 +278,12 @@ public:
 	inline const FunscriptAction* GetClosestAction(float time) noexcept { return getActionAtTime(data.Actions, time, std::numeric_limits<float>::max()); }
 
 	float GetPositionAtTime(float time) const noexcept;
+	// samples startTime + i * stepTime for every i < count with a single pass over the actions
+	// this is the same as calling GetPositionAtTime for each time
+	void SampleRange(float startTime, float stepTime, size_t count, float* outPositions) const noexcept;
 	
 	inline void AddAction(FunscriptAction newAction) noexcept { addAction(data.Actions, newAction); }
+	// merges all actions in a single pass, actions colliding with existing ones are skipped
 	void AddMultipleActions(const FunscriptArray& actions) noexcept;
 
 	bool EditAction(FunscriptAction oldAction, FunscriptAction newAction) noexcept;
@@ -233,9 +294,11 @@ public:
 	std::vector<FunscriptAction> GetLastStroke(float time) noexcept;
 
 	void SetActions(const FunscriptArray& override_with) noexcept;
+	void SetActions(FunscriptArray&& override_with) noexcept;
 
 	inline bool HasUnsavedEdits() const { return unsavedEdits; }
 	inline const std::chrono::system_clock::time_point& EditTime() const { return editTime; }
+	inline uint32_t Revision() const noexcept { return revision; }
 
 	void RemoveActionsInInterval(float fromTime, float toTime) noexcept;
 
@@ -275,6 +338,11 @@ public:
 	inline const float SplineClamped(float time) noexcept {
 		return Util::Clamp<float>(Spline(time) * 100.f, 0.f, 100.f);
 	}
+
+	// batched Spline, see SampleRange
+	inline void SplineRange(float startTime, float stepTime, size_t count, float* outPositions) const noexcept {
+		FunscriptSpline::SampleRange(data.Actions, startTime, stepTime, count, outPositions);
+	}
 };
 
 REFL_TYPE(Funscript::Metadata)
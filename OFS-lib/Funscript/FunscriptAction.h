@@ -6,6 +6,7 @@
 #include <limits>
 
 #include "OFS_VectorSet.h"
+#include "OFS_ChunkedSet.h"
 
 struct FunscriptAction
 {
@@ -81,4 +82,8 @@ struct ActionLess
 };
 
 
+#if OFS_CHUNKED_ACTIONS
+using FunscriptArray = chunked_set<FunscriptAction, ActionLess>;
+#else
 using FunscriptArray = vector_set<FunscriptAction, ActionLess>;
+#endif
@@ -0,0 +1,293 @@
+#include "FunscriptActionKernels.h"
+#include "OFS_Util.h"
+#include "OFS_Profiling.h"
+#include "OFS_Simd.h"
+
+#include <algorithm>
+#include <cstddef>
+
+static_assert(sizeof(FunscriptAction) == 8 && offsetof(FunscriptAction, atS) == 0 && offsetof(FunscriptAction, pos) == 4,
+	"the kernels depend on this layout");
+
+#if OFS_AVX
+// float(i + 0..7), AVX1 has no 256bit integer add so it's built from two halves
+inline static __m256 sampleIndices8(size_t i) noexcept
+{
+	__m128i base = _mm_set1_epi32((int32_t)i);
+	__m128i low = _mm_add_epi32(base, _mm_setr_epi32(0, 1, 2, 3));
+	__m128i high = _mm_add_epi32(base, _mm_setr_epi32(4, 5, 6, 7));
+	return _mm256_cvtepi32_ps(_mm256_insertf128_si256(_mm256_castsi128_si256(low), high, 1));
+}
+#elif OFS_SSE2
+// float(i + 0..3)
+inline static __m128 sampleIndices4(size_t i) noexcept
+{
+	return _mm_cvtepi32_ps(_mm_add_epi32(_mm_set1_epi32((int32_t)i), _mm_setr_epi32(0, 1, 2, 3)));
+}
+#endif
+
+void FunscriptActionSoA::LoadRange(const FunscriptArray& actions, float startTime, float endTime, size_t neighbours) noexcept
+{
+	OFS_PROFILE(__FUNCTION__);
+	size_t first = std::distance(actions.begin(), actions.upper_bound(FunscriptAction(startTime, 0)));
+	size_t last = std::distance(actions.begin(), actions.upper_bound(FunscriptAction(endTime, 0)));
+	// the action before startTime and the one after endTime are needed for interpolation
+	first = first > neighbours + 1 ? first - neighbours - 1 : 0;
+	last = std::min(last + neighbours + 1, actions.size());
+
+	atS.resize(last - first);
+	pos.resize(last - first);
+	auto it = actions.begin() + first;
+	for (size_t i = 0, size = last - first; i < size; ++i, ++it) {
+		atS[i] = it->atS;
+		pos[i] = it->pos;
+	}
+}
+
+void FunscriptActionKernels::OffsetTime(FunscriptAction* actions, size_t count, float offset) noexcept
+{
+	OFS_PROFILE(__FUNCTION__);
+	size_t i = 0;
+	// the non time lanes are masked to zero before the add
+	// adding to pos/flags/tag bits directly would mostly be denormal floats which are slow
+	// with only SSE2 the compiler does about as well with the plain loop
+#if OFS_AVX
+	{
+		const __m256 timeMask = _mm256_castsi256_ps(_mm256_setr_epi32(-1, 0, -1, 0, -1, 0, -1, 0));
+		const __m256 off = _mm256_set1_ps(offset);
+		for (; i + 4 <= count; i += 4) {
+			float* ptr = reinterpret_cast<float*>(actions + i);
+			__m256 v = _mm256_loadu_ps(ptr);
+			__m256 moved = _mm256_add_ps(_mm256_and_ps(v, timeMask), off);
+			_mm256_storeu_ps(ptr, _mm256_blend_ps(v, moved, 0x55));
+		}
+	}
+#endif
+	for (; i < count; ++i) {
+		actions[i].atS += offset;
+	}
+}
+
+void FunscriptActionKernels::OffsetPosition(FunscriptAction* actions, size_t count, int32_t offset) noexcept
+{
+	OFS_PROFILE(__FUNCTION__);
+	offset = Util::Clamp<int32_t>(offset, -100, 100);
+	size_t i = 0;
+#if OFS_SSE2
+	{
+		// every action is 4 int16 lanes [atS, atS, pos, flags|tag]
+		const __m128i posMask = _mm_setr_epi16(0, 0, -1, 0, 0, 0, -1, 0);
+		const __m128i off = _mm_set1_epi16((int16_t)offset);
+		const __m128i minPos = _mm_set1_epi16(0);
+		const __m128i maxPos = _mm_set1_epi16(100);
+		for (; i + 2 <= count; i += 2) {
+			__m128i* ptr = reinterpret_cast<__m128i*>(actions + i);
+			__m128i v = _mm_loadu_si128(ptr);
+			__m128i moved = _mm_adds_epi16(v, off);
+			moved = _mm_min_epi16(_mm_max_epi16(moved, minPos), maxPos);
+			_mm_storeu_si128(ptr, _mm_or_si128(_mm_and_si128(posMask, moved), _mm_andnot_si128(posMask, v)));
+		}
+	}
+#endif
+	for (; i < count; ++i) {
+		actions[i].pos = Util::Clamp<int32_t>(actions[i].pos + offset, 0, 100);
+	}
+}
+
+void FunscriptActionKernels::InvertPosition(FunscriptAction* actions, size_t count) noexcept
+{
+	OFS_PROFILE(__FUNCTION__);
+	size_t i = 0;
+#if OFS_SSE2
+	{
+		const __m128i posMask = _mm_setr_epi16(0, 0, -1, 0, 0, 0, -1, 0);
+		const __m128i hundred = _mm_set1_epi16(100);
+		const __m128i zero = _mm_setzero_si128();
+		for (; i + 2 <= count; i += 2) {
+			__m128i* ptr = reinterpret_cast<__m128i*>(actions + i);
+			__m128i v = _mm_loadu_si128(ptr);
+			__m128i inverted = _mm_sub_epi16(v, hundred);
+			inverted = _mm_max_epi16(inverted, _mm_sub_epi16(zero, inverted)); // abs
+			_mm_storeu_si128(ptr, _mm_or_si128(_mm_and_si128(posMask, inverted), _mm_andnot_si128(posMask, v)));
+		}
+	}
+#endif
+	for (; i < count; ++i) {
+		actions[i].pos = std::abs(actions[i].pos - 100);
+	}
+}
+
+// walks the actions once and calls runFn(first, last, segment) for every run of samples
+// which falls between the same two actions
+template<typename RunFn>
+inline static void sampleRuns(const FunscriptActionSoA& actions, float startTime, float stepTime, float* outPositions, size_t count,
+	float beforeFirst, float afterLast, RunFn&& runFn) noexcept
+{
+	FUN_ASSERT(stepTime >= 0.f, "times have to be ascending");
+	const size_t actionCount = actions.size();
+	if (actionCount < 2) {
+		size_t i = 0;
+		for (; actionCount == 1 && i < count && startTime + (float)i * stepTime < actions.atS[0]; ++i) {
+			outPositions[i] = beforeFirst;
+		}
+		std::fill(outPositions + i, outPositions + count, afterLast);
+		return;
+	}
+
+	// same expression everywhere so the vector and scalar paths produce the same times
+	auto timeAt = [startTime, stepTime](size_t i) noexcept { return startTime + (float)i * stepTime; };
+
+	const float* atS = actions.atS.data();
+	const float firstTime = atS[0];
+	const float lastTime = atS[actionCount - 1];
+
+	size_t i = 0;
+	size_t segment = 0;
+	while (i < count) {
+		float time = timeAt(i);
+		if (time < firstTime) {
+			outPositions[i++] = beforeFirst;
+			continue;
+		}
+		if (time >= lastTime) {
+			// times are ascending so everything after this is past the end as well
+			std::fill(outPositions + i, outPositions + count, afterLast);
+			return;
+		}
+
+		if (atS[segment + 1] <= time) {
+			segment = std::upper_bound(atS + segment + 1, atS + actionCount, time) - atS - 1;
+		}
+		const float t1 = atS[segment + 1];
+
+		// find the end of the run of samples which fall into this segment
+		size_t runEnd = count;
+		if (stepTime > 0.f) {
+			float estimate = (t1 - startTime) / stepTime;
+			runEnd = estimate < (float)count ? std::max((size_t)estimate, i + 1) : count;
+			while (runEnd > i + 1 && timeAt(runEnd - 1) >= t1) --runEnd;
+			while (runEnd < count && timeAt(runEnd) < t1) ++runEnd;
+		}
+
+		runFn(i, runEnd, segment);
+		i = runEnd;
+	}
+}
+
+void FunscriptActionKernels::SampleLinear(const FunscriptActionSoA& actions, float startTime, float stepTime, float* outPositions, size_t count,
+	float beforeFirst, float afterLast) noexcept
+{
+	OFS_PROFILE(__FUNCTION__);
+	sampleRuns(actions, startTime, stepTime, outPositions, count, beforeFirst, afterLast,
+		[&actions, startTime, stepTime, outPositions](size_t i, size_t runEnd, size_t segment) noexcept {
+		const float t0 = actions.atS[segment];
+		const float p0 = actions.pos[segment];
+		const float diff = (float)(actions.pos[segment + 1] - actions.pos[segment]);
+		const float duration = actions.atS[segment + 1] - t0;
+
+#if OFS_AVX
+		{
+			const __m256 vStart = _mm256_set1_ps(startTime), vStep = _mm256_set1_ps(stepTime);
+			const __m256 vT0 = _mm256_set1_ps(t0), vDuration = _mm256_set1_ps(duration);
+			const __m256 vP0 = _mm256_set1_ps(p0), vDiff = _mm256_set1_ps(diff);
+			for (; i + 8 <= runEnd; i += 8) {
+				__m256 time = _mm256_add_ps(vStart, _mm256_mul_ps(sampleIndices8(i), vStep));
+				__m256 progress = _mm256_div_ps(_mm256_sub_ps(time, vT0), vDuration);
+				_mm256_storeu_ps(outPositions + i, _mm256_add_ps(vP0, _mm256_mul_ps(progress, vDiff)));
+			}
+		}
+#elif OFS_SSE2
+		{
+			const __m128 vStart = _mm_set1_ps(startTime), vStep = _mm_set1_ps(stepTime);
+			const __m128 vT0 = _mm_set1_ps(t0), vDuration = _mm_set1_ps(duration);
+			const __m128 vP0 = _mm_set1_ps(p0), vDiff = _mm_set1_ps(diff);
+			for (; i + 4 <= runEnd; i += 4) {
+				__m128 time = _mm_add_ps(vStart, _mm_mul_ps(sampleIndices4(i), vStep));
+				__m128 progress = _mm_div_ps(_mm_sub_ps(time, vT0), vDuration);
+				_mm_storeu_ps(outPositions + i, _mm_add_ps(vP0, _mm_mul_ps(progress, vDiff)));
+			}
+		}
+#endif
+		for (; i < runEnd; ++i) {
+			float progress = ((startTime + (float)i * stepTime) - t0) / duration;
+			outPositions[i] = p0 + progress * diff;
+		}
+	});
+}
+
+void FunscriptActionKernels::SampleSpline(const FunscriptActionSoA& actions, float startTime, float stepTime, float* outPositions, size_t count,
+	float beforeFirst, float afterLast) noexcept
+{
+	OFS_PROFILE(__FUNCTION__);
+	sampleRuns(actions, startTime, stepTime, outPositions, count, beforeFirst, afterLast,
+		[&actions, startTime, stepTime, outPositions](size_t i, size_t runEnd, size_t segment) noexcept {
+		const size_t last = actions.size() - 1;
+		const float v0 = actions.pos[segment > 0 ? segment - 1 : 0] / 100.f;
+		const float v1 = actions.pos[segment] / 100.f;
+		const float v2 = actions.pos[segment + 1] / 100.f;
+		const float v3 = actions.pos[std::min(segment + 2, last)] / 100.f;
+
+		if (actions.pos[segment] == actions.pos[segment + 1]) {
+			// flat, same as FunscriptSpline::catmul_rom_spline_alt
+			std::fill(outPositions + i, outPositions + runEnd, v1);
+			return;
+		}
+
+		const float t0 = actions.atS[segment];
+		const float duration = actions.atS[segment + 1] - t0;
+
+		// glm::catmullRom
+		// ((-s3 + 2s2 - s) * v0 + (3s3 - 5s2 + 2) * v1 + (-3s3 + 4s2 + s) * v2 + (s3 - s2) * v3) / 2
+#if OFS_AVX
+		{
+			const __m256 vStart = _mm256_set1_ps(startTime), vStep = _mm256_set1_ps(stepTime);
+			const __m256 vT0 = _mm256_set1_ps(t0), vDuration = _mm256_set1_ps(duration);
+			const __m256 vV0 = _mm256_set1_ps(v0), vV1 = _mm256_set1_ps(v1), vV2 = _mm256_set1_ps(v2), vV3 = _mm256_set1_ps(v3);
+			const __m256 two = _mm256_set1_ps(2.f), three = _mm256_set1_ps(3.f), four = _mm256_set1_ps(4.f), five = _mm256_set1_ps(5.f), half = _mm256_set1_ps(.5f);
+			for (; i + 8 <= runEnd; i += 8) {
+				__m256 time = _mm256_add_ps(vStart, _mm256_mul_ps(sampleIndices8(i), vStep));
+				__m256 s = _mm256_div_ps(_mm256_sub_ps(time, vT0), vDuration);
+				__m256 s2 = _mm256_mul_ps(s, s);
+				__m256 s3 = _mm256_mul_ps(s2, s);
+				__m256 f0 = _mm256_sub_ps(_mm256_sub_ps(_mm256_mul_ps(two, s2), s3), s);
+				__m256 f1 = _mm256_add_ps(_mm256_sub_ps(_mm256_mul_ps(three, s3), _mm256_mul_ps(five, s2)), two);
+				__m256 f2 = _mm256_add_ps(_mm256_sub_ps(_mm256_mul_ps(four, s2), _mm256_mul_ps(three, s3)), s);
+				__m256 f3 = _mm256_sub_ps(s3, s2);
+				__m256 sum = _mm256_add_ps(_mm256_mul_ps(f0, vV0), _mm256_mul_ps(f1, vV1));
+				sum = _mm256_add_ps(_mm256_add_ps(sum, _mm256_mul_ps(f2, vV2)), _mm256_mul_ps(f3, vV3));
+				_mm256_storeu_ps(outPositions + i, _mm256_mul_ps(sum, half));
+			}
+		}
+#elif OFS_SSE2
+		{
+			const __m128 vStart = _mm_set1_ps(startTime), vStep = _mm_set1_ps(stepTime);
+			const __m128 vT0 = _mm_set1_ps(t0), vDuration = _mm_set1_ps(duration);
+			const __m128 vV0 = _mm_set1_ps(v0), vV1 = _mm_set1_ps(v1), vV2 = _mm_set1_ps(v2), vV3 = _mm_set1_ps(v3);
+			const __m128 two = _mm_set1_ps(2.f), three = _mm_set1_ps(3.f), four = _mm_set1_ps(4.f), five = _mm_set1_ps(5.f), half = _mm_set1_ps(.5f);
+			for (; i + 4 <= runEnd; i += 4) {
+				__m128 time = _mm_add_ps(vStart, _mm_mul_ps(sampleIndices4(i), vStep));
+				__m128 s = _mm_div_ps(_mm_sub_ps(time, vT0), vDuration);
+				__m128 s2 = _mm_mul_ps(s, s);
+				__m128 s3 = _mm_mul_ps(s2, s);
+				__m128 f0 = _mm_sub_ps(_mm_sub_ps(_mm_mul_ps(two, s2), s3), s);
+				__m128 f1 = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(three, s3), _mm_mul_ps(five, s2)), two);
+				__m128 f2 = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(four, s2), _mm_mul_ps(three, s3)), s);
+				__m128 f3 = _mm_sub_ps(s3, s2);
+				__m128 sum = _mm_add_ps(_mm_mul_ps(f0, vV0), _mm_mul_ps(f1, vV1));
+				sum = _mm_add_ps(_mm_add_ps(sum, _mm_mul_ps(f2, vV2)), _mm_mul_ps(f3, vV3));
+				_mm_storeu_ps(outPositions + i, _mm_mul_ps(sum, half));
+			}
+		}
+#endif
+		for (; i < runEnd; ++i) {
+			float s = ((startTime + (float)i * stepTime) - t0) / duration;
+			float s2 = s * s;
+			float s3 = s2 * s;
+			float f0 = 2.f * s2 - s3 - s;
+			float f1 = 3.f * s3 - 5.f * s2 + 2.f;
+			float f2 = 4.f * s2 - 3.f * s3 + s;
+			float f3 = s3 - s2;
+			outPositions[i] = (f0 * v0 + f1 * v1 + f2 * v2 + f3 * v3) * .5f;
+		}
+	});
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "FunscriptAction.h"
+
+#include <vector>
+#include <cstdint>
+
+// Struct of arrays mirror of a FunscriptArray.
+// Sampling only needs time and position, splitting them keeps
+// the segment search dense and lets the kernels load several values at once.
+struct FunscriptActionSoA
+{
+	std::vector<float> atS;
+	std::vector<int16_t> pos;
+
+	// copies only the actions needed to sample between startTime and endTime
+	// neighbours adds extra actions on both sides, the spline needs one
+	void LoadRange(const FunscriptArray& actions, float startTime, float endTime, size_t neighbours) noexcept;
+	inline size_t size() const noexcept { return atS.size(); }
+	inline bool empty() const noexcept { return atS.empty(); }
+};
+
+// Bulk transforms over contiguous FunscriptActions & sampling over FunscriptActionSoA.
+// Uses SSE2 and AVX if OFS_AVX is enabled, falls back to plain loops otherwise.
+struct FunscriptActionKernels
+{
+	static void OffsetTime(FunscriptAction* actions, size_t count, float offset) noexcept;
+	// adds offset to every position and clamps the result to 0-100
+	static void OffsetPosition(FunscriptAction* actions, size_t count, int32_t offset) noexcept;
+	// pos = abs(pos - 100)
+	static void InvertPosition(FunscriptAction* actions, size_t count) noexcept;
+
+	// samples the position at startTime + i * stepTime for every i < count
+	// inbetween actions this matches Funscript::GetPositionAtTime
+	// times before the first or after the last action get beforeFirst/afterLast
+	static void SampleLinear(const FunscriptActionSoA& actions, float startTime, float stepTime, float* outPositions, size_t count,
+		float beforeFirst, float afterLast) noexcept;
+	// same as SampleLinear but catmull-rom like FunscriptSpline, the result is 0-1 instead of 0-100
+	static void SampleSpline(const FunscriptActionSoA& actions, float startTime, float stepTime, float* outPositions, size_t count,
+		float beforeFirst, float afterLast) noexcept;
+
+	template<typename Array, typename Fn>
+	inline static void ForEachSpan(Array& actions, Fn&& fn) noexcept
+	{
+		actions.for_each_span(std::forward<Fn>(fn));
+	}
+
+	inline static void OffsetTime(FunscriptArray& actions, float offset) noexcept
+	{
+		// a constant offset keeps the actions sorted
+		ForEachSpan(actions, [offset](FunscriptAction* a, size_t n) noexcept { OffsetTime(a, n, offset); });
+	}
+
+	inline static void OffsetPosition(FunscriptArray& actions, int32_t offset) noexcept
+	{
+		ForEachSpan(actions, [offset](FunscriptAction* a, size_t n) noexcept { OffsetPosition(a, n, offset); });
+	}
+
+	inline static void InvertPosition(FunscriptArray& actions) noexcept
+	{
+		ForEachSpan(actions, [](FunscriptAction* a, size_t n) noexcept { InvertPosition(a, n); });
+	}
+};
@@ -9,6 +9,7 @@
 #include <chrono>
 #include <memory>
 #include <array>
+#include <algorithm>
 
 ImGradient FunscriptHeatmap::Colors;
 ImGradient FunscriptHeatmap::LineColors;
@@ -147,19 +148,26 @@ FunscriptHeatmap::FunscriptHeatmap() noexcept
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, SpeedTextureResolution, 1, 0, GL_RED, GL_UNSIGNED_BYTE, 0);
     glBindTexture(GL_TEXTURE_2D, 0);
+
+    speedBuffer.resize(SpeedTextureResolution, 0.f);
+    sampleCountBuffer.resize(SpeedTextureResolution, 0);
+    textureBuffer.resize(SpeedTextureResolution, 0.f);
 }
 
-void FunscriptHeatmap::Update(float totalDuration, const FunscriptArray& actions) noexcept
+// sums up the speed of every stroke per bin and writes the normalized 0-1 speeds of firstBin-lastBin to outSpeeds
+// the same binning is used for the speed texture, the CPU rasterizer and SpeedBins
+static void binSpeeds(const FunscriptArray& actions, float timeStep, uint32_t binCount, uint32_t firstBin, uint32_t lastBin,
+    float* speedBuffer, uint16_t* sampleCountBuffer, float* outSpeeds) noexcept
 {
     OFS_PROFILE(__FUNCTION__);
-    std::vector<float> speedBuffer; 
-    speedBuffer.resize(SpeedTextureResolution, 0.f);
-    std::vector<uint16_t> sampleCountBuffer;
-    sampleCountBuffer.resize(SpeedTextureResolution, 0);
+    std::fill(speedBuffer + firstBin, speedBuffer + lastBin + 1, 0.f);
+    std::fill(sampleCountBuffer + firstBin, sampleCountBuffer + lastBin + 1, 0);
 
-    float timeStep = totalDuration / SpeedTextureResolution;
+    // start a few actions early, pairs outside of the bin range don't contribute anything
+    uint32_t startIdx = std::distance(actions.begin(), actions.lower_bound(FunscriptAction(firstBin * timeStep, 0)));
+    startIdx = startIdx > 2 ? startIdx - 2 : 0;
 
-    for(uint32_t i = 0, j = 1, size = actions.size(); j < size; i = j++)
+    for(uint32_t i = startIdx, j = startIdx + 1, size = actions.size(); j < size; i = j++)
     {
         auto prev = actions[i];
         auto next = actions[j];
@@ -169,9 +177,12 @@ void FunscriptHeatmap::Update(float totalDuration, const FunscriptArray& actions
     
         uint32_t prevSampleIdx = prev.atS / timeStep;
         uint32_t nextSampleIdx = next.atS / timeStep;
+        // every following stroke starts after lastBin
+        if(prev.atS / timeStep >= lastBin + 2.f) break;
+
         if(prevSampleIdx == nextSampleIdx)
         {
-            if(prevSampleIdx < SpeedTextureResolution)
+            if(prevSampleIdx >= firstBin && prevSampleIdx <= lastBin)
             {
                 sampleCountBuffer[prevSampleIdx] += 1;
                 speedBuffer[prevSampleIdx] += speed;
@@ -179,9 +190,9 @@ void FunscriptHeatmap::Update(float totalDuration, const FunscriptArray& actions
         }
         else
         {
-            if(prevSampleIdx < SpeedTextureResolution && nextSampleIdx < SpeedTextureResolution)
+            if(prevSampleIdx < binCount && nextSampleIdx < binCount)
             {
-                for(int x = prevSampleIdx; x < nextSampleIdx; x += 1)
+                for(uint32_t x = std::max(prevSampleIdx, firstBin), end = std::min(nextSampleIdx, lastBin + 1); x < end; x += 1)
                 {
                     sampleCountBuffer[x] += 1;
                     speedBuffer[x] += speed;
@@ -190,18 +201,53 @@ void FunscriptHeatmap::Update(float totalDuration, const FunscriptArray& actions
         }
     }
 
-    for(uint32_t i=0; i < SpeedTextureResolution; i += 1)
+    for(uint32_t i = firstBin; i <= lastBin; i += 1)
     {
-        speedBuffer[i] /= sampleCountBuffer[i] > 0 ? (float)sampleCountBuffer[i] : 1.f;
-        speedBuffer[i] /= MaxSpeedPerSecond;
-        speedBuffer[i] = Util::Clamp(speedBuffer[i], 0.f, 1.f);
+        float speed = speedBuffer[i] / (sampleCountBuffer[i] > 0 ? (float)sampleCountBuffer[i] : 1.f);
+        speed /= FunscriptHeatmap::MaxSpeedPerSecond;
+        outSpeeds[i] = Util::Clamp(speed, 0.f, 1.f);
     }
+}
+
+void FunscriptHeatmap::updateBins(const FunscriptArray& actions, uint32_t firstBin, uint32_t lastBin) noexcept
+{
+    OFS_PROFILE(__FUNCTION__);
+    float timeStep = builtDuration / SpeedTextureResolution;
+    binSpeeds(actions, timeStep, SpeedTextureResolution, firstBin, lastBin, speedBuffer.data(), sampleCountBuffer.data(), textureBuffer.data());
 
     glBindTexture(GL_TEXTURE_2D, speedTexture);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, SpeedTextureResolution, 1, 0, GL_RED, GL_FLOAT, speedBuffer.data());
+    glTexSubImage2D(GL_TEXTURE_2D, 0, firstBin, 0, lastBin - firstBin + 1, 1, GL_RED, GL_FLOAT, textureBuffer.data() + firstBin);
     glBindTexture(GL_TEXTURE_2D, 0);
 }
 
+void FunscriptHeatmap::Update(float totalDuration, const FunscriptArray& actions) noexcept
+{
+    OFS_PROFILE(__FUNCTION__);
+    builtDuration = totalDuration;
+    updateBins(actions, 0, SpeedTextureResolution - 1);
+}
+
+void FunscriptHeatmap::UpdateRange(float totalDuration, const FunscriptArray& actions, float fromTime, float toTime) noexcept
+{
+    OFS_PROFILE(__FUNCTION__);
+    if (totalDuration != builtDuration) {
+        Update(totalDuration, actions);
+        return;
+    }
+
+    // actions outside of the range didn't change so the strokes which changed
+    // lie between the last action before fromTime and the first action after toTime
+    float timeStep = builtDuration / SpeedTextureResolution;
+    auto prevIt = actions.lower_bound(FunscriptAction(fromTime, 0));
+    auto nextIt = actions.upper_bound(FunscriptAction(toTime, 0));
+    float from = prevIt == actions.begin() ? 0.f : (prevIt - 1)->atS;
+    float to = nextIt == actions.end() ? builtDuration : nextIt->atS;
+
+    uint32_t firstBin = Util::Clamp<float>(from / timeStep, 0.f, SpeedTextureResolution - 1);
+    uint32_t lastBin = Util::Clamp<float>(to / timeStep, 0.f, SpeedTextureResolution - 1);
+    updateBins(actions, firstBin, lastBin);
+}
+
 void FunscriptHeatmap::DrawHeatmap(ImDrawList* drawList, const ImVec2& min, const ImVec2& max) noexcept
 {
     drawList->AddCallback([](const ImDrawList* parentList, const ImDrawCmd* cmd) noexcept
@@ -232,79 +278,94 @@ void FunscriptHeatmap::DrawHeatmap(ImDrawList* drawList, const ImVec2& min, cons
     drawList->AddCallback(ImDrawCallback_ResetRenderState, 0);
 }
 
-#include "imgui_impl/imgui_impl_opengl3.h"
-
-std::vector<uint8_t> FunscriptHeatmap::RenderToBitmap(int16_t width, int16_t height) noexcept
+// CPU version of the RAMP function in the heatmap shader
+static void rampColor(float speed, float outColor[3]) noexcept
 {
-    width = Util::Min(width, FunscriptHeatmap::MaxResolution);
-    height = Util::Min(height, FunscriptHeatmap::MaxResolution);
-
-    // Prepare temporary framebuffer
-    uint32_t tmpFramebuffer = 0;
-    uint32_t tmpColorTex = 0;
-
-    glGenFramebuffers(1, &tmpFramebuffer);
-    glBindFramebuffer(GL_FRAMEBUFFER, tmpFramebuffer);
-
-    glGenTextures(1, &tmpColorTex);
-    glBindTexture(GL_TEXTURE_2D, tmpColorTex);
-
-    glTexImage2D(GL_TEXTURE_2D, 0, OFS_InternalTexFormat, width, height, 0, OFS_TexFormat, GL_UNSIGNED_BYTE, 0);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, tmpColorTex, 0);
-    GLenum DrawBuffers[1] = { GL_COLOR_ATTACHMENT0 };
-    glDrawBuffers(1, DrawBuffers);
-    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
-        // FIXME: leaking memory
-        return {};
+    static constexpr float colors[6][3] = {
+        { 0.f, 0.f, 0.f },
+        { 30.f / 255.f, 144.f / 255.f, 1.f },
+        { 0.f, 1.f, 1.f },
+        { 0.f, 1.f, 0.f },
+        { 1.f, 1.f, 0.f },
+        { 1.f, 0.f, 0.f },
+    };
+    float x = speed * 5.f;
+    // the shader reads past the end for a speed of exactly 1.0
+    int idx = Util::Clamp((int)x, 0, 4);
+    float t = Util::Clamp(x - idx, 0.f, 1.f);
+    t = t * t * (3.f - 2.f * t); // smoothstep
+    for(int i = 0; i < 3; i += 1)
+    {
+        outColor[i] = colors[idx][i] + (colors[idx + 1][i] - colors[idx][i]) * t;
     }
+}
 
-    // Backup out main ImGuiContext
-    auto prevContext = ImGui::GetCurrentContext();
-
-    // Create a temporary ImGuiContext
-    auto tmpContext = ImGui::CreateContext();
-    ImGui::SetCurrentContext(tmpContext);
-    ImGui_ImplOpenGL3_Init(OFS_SHADER_VERSION);
-
-    // Prepare drawing a single image
-    auto& io = ImGui::GetIO();
-    io.DisplaySize.x = width;
-    io.DisplaySize.y = height;
-    ImGui_ImplOpenGL3_NewFrame();
-    ImGui::NewFrame();
+// rasterizes the heatmap like the shader does with a linear filtered speed texture
+// rows are bottom to top like glReadPixels
+static std::vector<uint8_t> rasterize(const float* speeds, int16_t width, int16_t height) noexcept
+{
+    OFS_PROFILE(__FUNCTION__);
+    width = Util::Clamp<int16_t>(width, 1, FunscriptHeatmap::MaxResolution);
+    height = Util::Clamp<int16_t>(height, 1, FunscriptHeatmap::MaxResolution);
 
-    // Draw calls
+    // every column has one color which only fades to black towards the top
+    std::vector<float> columns;
+    columns.resize((size_t)width * 3);
+    for(int x = 0; x < width; x += 1)
     {
-        auto drawList = ImGui::GetForegroundDrawList(ImGui::GetMainViewport());
-        DrawHeatmap(drawList, ImVec2(0.f, 0.f), ImVec2(width, height));
+        float texel = ((x + 0.5f) / width) * SpeedTextureResolution - 0.5f;
+        texel = Util::Clamp(texel, 0.f, SpeedTextureResolution - 1.f);
+        int idx0 = (int)texel;
+        int idx1 = Util::Min(idx0 + 1, SpeedTextureResolution - 1);
+        float speed = speeds[idx0] + (speeds[idx1] - speeds[idx0]) * (texel - idx0);
+        rampColor(speed, &columns[x * 3]);
     }
 
-    // Render image
-    ImGui::Render();
-    OFS_ImGui::CurrentlyRenderedViewport = ImGui::GetMainViewport();
-	ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
-    OFS_ImGui::CurrentlyRenderedViewport = nullptr;
-
-
-    // Grab the bitmap
     std::vector<uint8_t> bitmap;
     bitmap.resize((size_t)width * (size_t)height * 4);
-    glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, bitmap.data());
+    for(int y = 0; y < height; y += 1)
+    {
+        // uv.y is 0 at the top of the image
+        float fade = (height - y - 0.5f) / height;
+        uint8_t* row = &bitmap[(size_t)y * width * 4];
+        for(int x = 0; x < width; x += 1)
+        {
+            row[x * 4 + 0] = (uint8_t)(columns[x * 3 + 0] * fade * 255.f + 0.5f);
+            row[x * 4 + 1] = (uint8_t)(columns[x * 3 + 1] * fade * 255.f + 0.5f);
+            row[x * 4 + 2] = (uint8_t)(columns[x * 3 + 2] * fade * 255.f + 0.5f);
+            row[x * 4 + 3] = 255;
+        }
+    }
+    return bitmap;
+}
 
-    // Destroy everything
-    ImGui_ImplOpenGL3_Shutdown();
-    ImGui::DestroyContext(tmpContext);
+std::vector<uint8_t> FunscriptHeatmap::RenderToBitmap(int16_t width, int16_t height) noexcept
+{
+    return rasterize(textureBuffer.data(), width, height);
+}
 
-    glDeleteTextures(1, &tmpColorTex);
-    glDeleteFramebuffers(1, &tmpFramebuffer);
+std::vector<uint8_t> FunscriptHeatmap::RenderToBitmap(float totalDuration, const FunscriptArray& actions, int16_t width, int16_t height) noexcept
+{
+    OFS_PROFILE(__FUNCTION__);
+    std::vector<float> speedBuffer(SpeedTextureResolution);
+    std::vector<uint16_t> sampleCountBuffer(SpeedTextureResolution);
+    std::vector<float> speeds(SpeedTextureResolution);
+    binSpeeds(actions, totalDuration / SpeedTextureResolution, SpeedTextureResolution, 0, SpeedTextureResolution - 1,
+        speedBuffer.data(), sampleCountBuffer.data(), speeds.data());
+    return rasterize(speeds.data(), width, height);
+}
 
-    // Reset to default framebuffer and main ImGuiContext    
-    ImGui::SetCurrentContext(prevContext);
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-    return bitmap;
-}
\ No newline at end of file
+std::vector<float> FunscriptHeatmap::SpeedBins(float totalDuration, const FunscriptArray& actions, uint32_t binCount) noexcept
+{
+    OFS_PROFILE(__FUNCTION__);
+    binCount = Util::Clamp<uint32_t>(binCount, 1, MaxResolution);
+    std::vector<float> speedBuffer(binCount);
+    std::vector<uint16_t> sampleCountBuffer(binCount);
+    std::vector<float> speeds(binCount);
+    if(totalDuration > 0.f)
+    {
+        binSpeeds(actions, totalDuration / binCount, binCount, 0, binCount - 1,
+            speedBuffer.data(), sampleCountBuffer.data(), speeds.data());
+    }
+    return speeds;
+}
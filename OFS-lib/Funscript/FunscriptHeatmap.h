@@ -4,6 +4,14 @@
 
 class FunscriptHeatmap
 {
+private:
+	// summed speeds and stroke counts per bin, kept around for partial updates
+	std::vector<float> speedBuffer;
+	std::vector<uint16_t> sampleCountBuffer;
+	std::vector<float> textureBuffer;
+	float builtDuration = -1.f;
+
+	void updateBins(const FunscriptArray& actions, uint32_t firstBin, uint32_t lastBin) noexcept;
 public:
 	static constexpr float MaxSpeedPerSecond = 400.f;
 	static constexpr int16_t MaxResolution = 4096;
@@ -19,6 +27,13 @@ public:
 
 	void DrawHeatmap(ImDrawList* drawList, const ImVec2& min, const ImVec2& max) noexcept;
 	void Update(float totalDuration , const FunscriptArray& actions) noexcept;
+	// only recomputes the bins affected by changes between fromTime and toTime
+	void UpdateRange(float totalDuration, const FunscriptArray& actions, float fromTime, float toTime) noexcept;
 
+	// rasterized on the CPU, rows are bottom to top like glReadPixels
 	std::vector<uint8_t> RenderToBitmap(int16_t width, int16_t height) noexcept;
+	// same as above without a heatmap instance or GL context, safe to call from any thread
+	static std::vector<uint8_t> RenderToBitmap(float totalDuration, const FunscriptArray& actions, int16_t width, int16_t height) noexcept;
+	// the normalized 0-1 speeds the heatmap is colored with, safe to call from any thread
+	static std::vector<float> SpeedBins(float totalDuration, const FunscriptArray& actions, uint32_t binCount) noexcept;
 };
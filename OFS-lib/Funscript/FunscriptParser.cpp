@@ -0,0 +1,238 @@
+#include "FunscriptParser.h"
+#include "OFS_Util.h"
+#include "OFS_Profiling.h"
+
+#include <cstring>
+#include <cstdint>
+
+namespace {
+
+class Reader
+{
+	const char* cur;
+	const char* end;
+public:
+	Reader(const char* text, size_t size) noexcept
+		: cur(text), end(text + size) {}
+
+	inline const char* Position() const noexcept { return cur; }
+	inline bool AtEnd() const noexcept { return cur >= end; }
+	inline char Peek() const noexcept { return cur < end ? *cur : '\0'; }
+
+	inline void SkipWhitespace() noexcept
+	{
+		while (cur < end && (*cur == ' ' || *cur == '\n' || *cur == '\r' || *cur == '\t')) ++cur;
+	}
+
+	inline bool Consume(char c) noexcept
+	{
+		SkipWhitespace();
+		if (cur < end && *cur == c) {
+			++cur;
+			return true;
+		}
+		return false;
+	}
+
+	// skips a string, outStart points at the raw content without the quotes
+	bool String(const char** outStart = nullptr, size_t* outLength = nullptr) noexcept
+	{
+		SkipWhitespace();
+		if (Peek() != '"') return false;
+		const char* start = ++cur;
+		while (cur < end && *cur != '"') {
+			if (*cur == '\\') ++cur;
+			++cur;
+		}
+		if (cur >= end) return false;
+		if (outStart) *outStart = start;
+		if (outLength) *outLength = cur - start;
+		++cur;
+		return true;
+	}
+
+	inline bool Key(const char* key, size_t keyLength, bool* outMatches) noexcept
+	{
+		const char* start; size_t length;
+		if (!String(&start, &length) || !Consume(':')) return false;
+		*outMatches = length == keyLength && std::memcmp(start, key, keyLength) == 0;
+		return true;
+	}
+
+	// only the exact fast path, anything which might round differently is rejected
+	bool Number(double* outValue) noexcept
+	{
+		SkipWhitespace();
+		bool negative = false;
+		if (Peek() == '-') {
+			negative = true;
+			++cur;
+		}
+
+		uint64_t mantissa = 0;
+		int digits = 0;
+		int exponent = 0;
+		const char* start = cur;
+		while (cur < end && *cur >= '0' && *cur <= '9') {
+			mantissa = mantissa * 10 + (*cur++ - '0');
+			++digits;
+		}
+		if (cur == start) return false;
+		if (Peek() == '.') {
+			++cur;
+			const char* fractionStart = cur;
+			while (cur < end && *cur >= '0' && *cur <= '9') {
+				mantissa = mantissa * 10 + (*cur++ - '0');
+				++digits;
+				--exponent;
+			}
+			if (cur == fractionStart) return false;
+		}
+		if (Peek() == 'e' || Peek() == 'E') {
+			++cur;
+			bool negativeExp = false;
+			if (Peek() == '+' || Peek() == '-') negativeExp = *cur++ == '-';
+			int exp = 0;
+			const char* expStart = cur;
+			while (cur < end && *cur >= '0' && *cur <= '9' && exp < 10000) {
+				exp = exp * 10 + (*cur++ - '0');
+			}
+			if (cur == expStart) return false;
+			exponent += negativeExp ? -exp : exp;
+		}
+
+		// mantissas up to 2^53 and powers of ten up to 1e22 are exact doubles
+		// so a single multiplication or division is correctly rounded
+		static constexpr double Pow10[] = {
+			1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+			1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+		};
+		if (digits > 15 || exponent < -22 || exponent > 22) return false;
+		double value = (double)mantissa;
+		value = exponent < 0 ? value / Pow10[-exponent] : value * Pow10[exponent];
+		*outValue = negative ? -value : value;
+		return true;
+	}
+
+	// skips any json value
+	bool SkipValue() noexcept
+	{
+		SkipWhitespace();
+		char c = Peek();
+		if (c == '"') return String();
+		if (c == '{' || c == '[') {
+			int depth = 0;
+			while (cur < end) {
+				char v = *cur;
+				if (v == '"') {
+					if (!String()) return false;
+					continue;
+				}
+				if (v == '{' || v == '[') ++depth;
+				else if (v == '}' || v == ']') {
+					if (--depth == 0) {
+						++cur;
+						return true;
+					}
+				}
+				++cur;
+			}
+			return false;
+		}
+		// numbers, true, false & null
+		const char* start = cur;
+		while (cur < end && *cur != ',' && *cur != '}' && *cur != ']'
+			&& *cur != ' ' && *cur != '\n' && *cur != '\r' && *cur != '\t') ++cur;
+		return cur != start;
+	}
+};
+
+}
+
+static bool parseAction(Reader& reader, std::vector<FunscriptAction>& outActions) noexcept
+{
+	if (!reader.Consume('{')) return false;
+
+	double at = 0.0, pos = 0.0;
+	bool hasAt = false, hasPos = false;
+	if (!reader.Consume('}')) {
+		do {
+			const char* keyStart; size_t keyLength;
+			if (!reader.String(&keyStart, &keyLength) || !reader.Consume(':')) return false;
+			bool isAt = keyLength == 2 && keyStart[0] == 'a' && keyStart[1] == 't';
+			bool isPos = keyLength == 3 && std::memcmp(keyStart, "pos", 3) == 0;
+			if (isAt) {
+				if (!reader.Number(&at)) return false;
+				hasAt = true;
+			}
+			else if (isPos) {
+				if (!reader.Number(&pos)) return false;
+				hasPos = true;
+			}
+			else if (!reader.SkipValue()) {
+				return false;
+			}
+		} while (reader.Consume(','));
+		if (!reader.Consume('}')) return false;
+	}
+
+	if (hasAt && hasPos) {
+		// same conversions as Funscript::Deserialize
+		float time = at / 1000.0;
+		int32_t position = (int32_t)Util::Clamp(pos, -1.0, 101.0);
+		if (time >= 0.f) {
+			outActions.emplace_back(time, Util::Clamp(position, 0, 100));
+		}
+	}
+	return true;
+}
+
+bool FunscriptParser::ParseActions(const char* text, size_t size, std::vector<FunscriptAction>& outActions, std::string& outRemainder) noexcept
+{
+	OFS_PROFILE(__FUNCTION__);
+	// utf-8 bom
+	if (size >= 3 && std::memcmp(text, "\xEF\xBB\xBF", 3) == 0) {
+		text += 3;
+		size -= 3;
+	}
+
+	Reader reader(text, size);
+	if (!reader.Consume('{')) return false;
+
+	const char* arrayStart = nullptr;
+	const char* arrayEnd = nullptr;
+	if (!reader.Consume('}')) {
+		do {
+			bool isActions;
+			if (!reader.Key("actions", 7, &isActions)) return false;
+			reader.SkipWhitespace();
+			if (isActions && reader.Peek() == '[') {
+				// a duplicate key wins in nlohmann::json, let it deal with that
+				if (arrayStart) return false;
+				arrayStart = reader.Position();
+				reader.Consume('[');
+				// every action is about 20 bytes
+				outActions.reserve(outActions.size() + size / 20);
+				if (!reader.Consume(']')) {
+					do {
+						if (!parseAction(reader, outActions)) return false;
+					} while (reader.Consume(','));
+					if (!reader.Consume(']')) return false;
+				}
+				arrayEnd = reader.Position();
+			}
+			else if (!reader.SkipValue()) {
+				return false;
+			}
+		} while (reader.Consume(','));
+		if (!reader.Consume('}')) return false;
+	}
+	if (!arrayStart) return false;
+
+	outRemainder.clear();
+	outRemainder.reserve((arrayStart - text) + 2 + (text + size - arrayEnd));
+	outRemainder.append(text, arrayStart);
+	outRemainder.append("[]");
+	outRemainder.append(arrayEnd, text + size);
+	return true;
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include "FunscriptAction.h"
+
+#include <vector>
+#include <string>
+
+// Hand rolled parser for the top level "actions" array of a funscript.
+// The actions are the bulk of every funscript, building a nlohmann::json DOM for them is
+// where most of the loading time went. Everything else is still left to nlohmann::json.
+class FunscriptParser
+{
+public:
+	// appends the actions in file order to outActions, actions without "at" or "pos" are skipped
+	// outRemainder gets the document with the actions array replaced by []
+	// returns false if there's no actions array or anything this parser doesn't handle
+	// in that case the caller should fall back to parsing everything with nlohmann::json
+	static bool ParseActions(const char* text, size_t size, std::vector<FunscriptAction>& outActions, std::string& outRemainder) noexcept;
+};
@@ -1,7 +1,9 @@
 #pragma once
 #include "OFS_Profiling.h"
 #include "FunscriptAction.h"
+#include "FunscriptActionKernels.h"
 #include <vector>
+#include <algorithm>
 #include "glm/gtx/spline.hpp"
 
 
@@ -85,6 +87,22 @@ public:
 		return 0.f;
 	}
 
+	// samples startTime + i * stepTime for every i < count with a single pass over the actions
+	// this is the same as calling Sample for each time
+	inline static void SampleRange(const FunscriptArray& actions, float startTime, float stepTime, size_t count, float* outPositions) noexcept
+	{
+		OFS_PROFILE(__FUNCTION__);
+		if (count == 0) return;
+		if (actions.empty()) {
+			std::fill_n(outPositions, count, 0.f);
+			return;
+		}
+		FunscriptActionSoA soa;
+		soa.LoadRange(actions, startTime, startTime + (float)(count - 1) * stepTime, 1);
+		FunscriptActionKernels::SampleSpline(soa, startTime, stepTime, outPositions, count,
+			actions.front().pos / 100.f, actions.back().pos / 100.f);
+	}
+
 	inline static float SampleAtIndex(const FunscriptArray& actions, int32_t index, float time) noexcept
 	{
 		OFS_PROFILE(__FUNCTION__);
@@ -1,19 +1,360 @@
 #include "FunscriptUndoSystem.h"
 
+#include "sdefl.h"
+#include "sinfl.h"
+
+#include <memory>
+#include <cstdlib>
+#include <filesystem>
+
+inline static bool identicalAction(FunscriptAction a, FunscriptAction b) noexcept
+{
+	return a.atS == b.atS && a.pos == b.pos && a.flags == b.flags && a.tag == b.tag;
+}
+
+FunscriptArrayDelta FunscriptArrayDelta::Diff(const FunscriptArray& newer, const FunscriptArray& older) noexcept
+{
+	OFS_PROFILE(__FUNCTION__);
+	FunscriptArrayDelta delta;
+	// both arrays are sorted by time so a single merge walk finds all differences
+	// every older action is either matched or inserted in order which keeps Apply correct
+	// even if the arrays weren't sorted, the delta just gets bigger
+	auto newIt = newer.begin(), newEnd = newer.end();
+	auto oldIt = older.begin(), oldEnd = older.end();
+	uint32_t newIdx = 0;
+	Hunk* hunk = nullptr;
+
+	auto openHunk = [&delta, &hunk, &newIdx]() noexcept {
+		if (hunk == nullptr) {
+			hunk = &delta.hunks.emplace_back();
+			hunk->index = newIdx;
+			hunk->removeCount = 0;
+			hunk->insertOffset = delta.inserts.size();
+			hunk->insertCount = 0;
+		}
+	};
+
+	while (newIt != newEnd || oldIt != oldEnd) {
+		if (newIt != newEnd && oldIt != oldEnd && identicalAction(*newIt, *oldIt)) {
+			hunk = nullptr;
+			++newIt; ++newIdx;
+			++oldIt;
+		}
+		else if (oldIt == oldEnd || (newIt != newEnd && newIt->atS <= oldIt->atS)) {
+			// removed or modified
+			openHunk();
+			hunk->removeCount += 1;
+			if (oldIt != oldEnd && newIt->atS == oldIt->atS) {
+				delta.inserts.emplace_back(*oldIt);
+				hunk->insertCount += 1;
+				++oldIt;
+			}
+			++newIt; ++newIdx;
+		}
+		else {
+			openHunk();
+			delta.inserts.emplace_back(*oldIt);
+			hunk->insertCount += 1;
+			++oldIt;
+		}
+	}
+
+	delta.hunks.shrink_to_fit();
+	delta.inserts.shrink_to_fit();
+	return delta;
+}
+
+void FunscriptArrayDelta::Apply(const FunscriptArray& newer, FunscriptArray& outOlder) const noexcept
+{
+	OFS_PROFILE(__FUNCTION__);
+	outOlder.clear();
+	outOlder.reserve(newer.size() + inserts.size());
+
+	auto newIt = newer.begin();
+	uint32_t newIdx = 0;
+	for (auto& hunk : hunks) {
+		for (; newIdx < hunk.index; ++newIdx, ++newIt) {
+			outOlder.emplace_back_unsorted(*newIt);
+		}
+		for (uint32_t i = 0; i < hunk.insertCount; ++i) {
+			outOlder.emplace_back_unsorted(inserts[hunk.insertOffset + i]);
+		}
+		newIt += hunk.removeCount;
+		newIdx += hunk.removeCount;
+	}
+	for (auto newEnd = newer.end(); newIt != newEnd; ++newIt) {
+		outOlder.emplace_back_unsorted(*newIt);
+	}
+}
+
+std::string UndoSpillFile::Directory() noexcept
+{
+	return (Util::PathFromString(Util::Prefpath("tmp/undo")) / std::to_string(Util::ProcessId())).u8string();
+}
+
+void UndoSpillFile::RemoveStaleDirectories() noexcept
+{
+	OFS_PROFILE(__FUNCTION__);
+	std::error_code ec;
+	auto root = Util::PathFromString(Util::Prefpath("tmp/undo"));
+	uint32_t ownId = Util::ProcessId();
+	for (auto& entry : std::filesystem::directory_iterator(root, ec)) {
+		if (!entry.is_directory(ec)) continue;
+		auto name = entry.path().filename().u8string();
+		char* end = nullptr;
+		auto pid = std::strtoul(name.c_str(), &end, 10);
+		if (name.empty() || *end != '\0') continue;
+		// our own directory can only be left over from a crashed process with the same id
+		if (pid == ownId || !Util::ProcessRunning((uint32_t)pid)) {
+			std::filesystem::remove_all(entry.path(), ec);
+		}
+	}
+}
+
+bool UndoSpillFile::Write(const std::vector<uint8_t>& buffer) noexcept
+{
+	FUN_ASSERT(path.empty(), "already spilled");
+	static uint32_t spillCounter = 0;
+	auto dir = Directory();
+	if (!Util::DirectoryExists(dir) && !Util::CreateDirectories(Util::PathFromString(dir))) {
+		return false;
+	}
+	auto filePath = (Util::PathFromString(dir) / Util::Format("%u.undo", spillCounter++)).u8string();
+	if (Util::WriteFile(filePath.c_str(), buffer.data(), buffer.size()) != buffer.size()) {
+		LOGF_ERROR("Failed to spill undo state to \"%s\"", filePath.c_str());
+		std::error_code ec;
+		std::filesystem::remove(Util::PathFromString(filePath), ec);
+		return false;
+	}
+	path = std::move(filePath);
+	return true;
+}
+
+bool UndoSpillFile::Read(std::vector<uint8_t>& buffer) noexcept
+{
+	FUN_ASSERT(!path.empty(), "nothing was spilled");
+	return Util::ReadFile(path.c_str(), buffer) > 0;
+}
+
+void UndoSpillFile::Remove() noexcept
+{
+	if (path.empty()) return;
+	std::error_code ec;
+	std::filesystem::remove(Util::PathFromString(path), ec);
+	path.clear();
+}
+
+void ScriptState::Compress() noexcept
+{
+	OFS_PROFILE(__FUNCTION__);
+	if (IsCompressed()) return;
+
+	// the context is ~800kb so it's kept around, this only runs on the main thread
+	static auto ctx = std::make_unique<sdefl>();
+	ByteBuffer buffer;
+	auto size = OFS_Binary::Serialize(buffer, *this);
+
+	compressed.resize(sdefl_bound(size));
+	compressedSize = sdeflate(ctx.get(), compressed.data(), buffer.data(), size, SDEFL_LVL_DEF);
+	compressed.resize(compressedSize);
+	compressed.shrink_to_fit();
+	uncompressedSize = size;
+
+	data = Funscript::FunscriptData();
+	actionsDelta = FunscriptArrayDelta();
+	selectionDelta = FunscriptArrayDelta();
+}
+
+bool ScriptState::Spill() noexcept
+{
+	OFS_PROFILE(__FUNCTION__);
+	FUN_ASSERT(IsCompressed(), "compress before spilling");
+	if (IsSpilled()) return true;
+	if (!spillFile.Write(compressed)) return false;
+	compressed = std::vector<uint8_t>();
+	return true;
+}
+
+bool ScriptState::restore() noexcept
+{
+	OFS_PROFILE(__FUNCTION__);
+	if (!IsCompressed()) return true;
+
+	bool restored = true;
+	if (IsSpilled()) {
+		restored = spillFile.Read(compressed) && compressed.size() == compressedSize;
+		spillFile.Remove();
+	}
+
+	ByteBuffer buffer;
+	if (restored) {
+		// sinflate reads up to 8 bytes past the input
+		compressed.resize(compressedSize + 8);
+		buffer.resize(uncompressedSize);
+		auto size = sinflate(buffer.data(), (int)buffer.size(), compressed.data(), (int)compressedSize);
+		restored = size == (int)uncompressedSize
+			&& OFS_Binary::Deserialize(buffer, *this) == bitsery::ReaderError::NoError;
+	}
+
+	compressed = std::vector<uint8_t>();
+	compressedSize = 0;
+	uncompressedSize = 0;
+	if (!restored) {
+		LOG_ERROR("Failed to restore compressed undo state.");
+		data = Funscript::FunscriptData();
+		actionsDelta = FunscriptArrayDelta();
+		selectionDelta = FunscriptArrayDelta();
+		keyframe = true;
+	}
+	return restored;
+}
+
+void ScriptState::MakeDelta(const Funscript::FunscriptData& newer) noexcept
+{
+	OFS_PROFILE(__FUNCTION__);
+	FUN_ASSERT(keyframe, "already a delta");
+	auto newActionsDelta = FunscriptArrayDelta::Diff(newer.Actions, data.Actions);
+	auto newSelectionDelta = FunscriptArrayDelta::Diff(newer.Selection, data.Selection);
+
+	// big edits like moving everything are cheaper to keep as a keyframe
+	if (newActionsDelta.MemoryUsage() + newSelectionDelta.MemoryUsage() < MemoryUsage()) {
+		actionsDelta = std::move(newActionsDelta);
+		selectionDelta = std::move(newSelectionDelta);
+		data = Funscript::FunscriptData();
+		keyframe = false;
+	}
+}
+
+bool ScriptState::MakeKeyframe(const Funscript::FunscriptData& newer) noexcept
+{
+	OFS_PROFILE(__FUNCTION__);
+	if (!restore()) return false;
+	if (keyframe) return true;
+	actionsDelta.Apply(newer.Actions, data.Actions);
+	selectionDelta.Apply(newer.Selection, data.Selection);
+	actionsDelta = FunscriptArrayDelta();
+	selectionDelta = FunscriptArrayDelta();
+	keyframe = true;
+	return true;
+}
+
+size_t ScriptState::MemoryUsage() const noexcept
+{
+	if (IsCompressed()) {
+		return IsSpilled() ? 0 : compressedSize;
+	}
+	if (keyframe) {
+		return (data.Actions.size() + data.Selection.size()) * sizeof(FunscriptAction);
+	}
+	return actionsDelta.MemoryUsage() + selectionDelta.MemoryUsage();
+}
+
+void ScriptStateStack::Push(int32_t type, const Funscript::FunscriptData& data) noexcept
+{
+	OFS_PROFILE(__FUNCTION__);
+	if (!states.empty()) {
+		auto& top = states.back();
+		memoryUsage -= top.MemoryUsage();
+		top.MakeDelta(data);
+		memoryUsage += top.MemoryUsage();
+	}
+	auto& state = states.emplace_back(type, data);
+	memoryUsage += state.MemoryUsage();
+}
+
+void ScriptStateStack::Pop(Funscript::FunscriptData& outData) noexcept
+{
+	OFS_PROFILE(__FUNCTION__);
+	FUN_ASSERT(!states.empty(), "stack is empty");
+	auto& top = states.back();
+	memoryUsage -= top.MemoryUsage();
+	outData = std::move(top.Data());
+	states.pop_back();
+
+	if (!states.empty()) {
+		// restore the next keyframe before the data is handed out
+		auto& newTop = states.back();
+		memoryUsage -= newTop.MemoryUsage();
+		diskUsage -= newTop.DiskUsage();
+		if (!newTop.MakeKeyframe(outData)) {
+			// everything below is stored relative to the lost state
+			LOGF_ERROR("Dropping %zu undo states.", states.size());
+			Clear();
+			return;
+		}
+		memoryUsage += newTop.MemoryUsage();
+	}
+}
+
+void ScriptStateStack::Clear() noexcept
+{
+	states.clear();
+	memoryUsage = 0;
+	diskUsage = 0;
+}
+
+size_t ScriptStateStack::Compact(size_t bytesToFree, bool& spillToDisk) noexcept
+{
+	OFS_PROFILE(__FUNCTION__);
+	if (states.size() < 2) return 0;
+	// small deltas aren't worth a compression pass or a file
+	constexpr size_t MinCompactSize = 1024;
+	size_t freed = 0;
+	auto end = states.end() - 1; // never the top
+
+	// oldest states first since they are the least likely to be needed again
+	for (auto it = states.begin(); it != end && freed < bytesToFree; ++it) {
+		if (it->IsCompressed() || it->MemoryUsage() < MinCompactSize) continue;
+		auto before = it->MemoryUsage();
+		it->Compress();
+		auto after = it->MemoryUsage();
+		memoryUsage -= before;
+		memoryUsage += after;
+		freed += before > after ? before - after : 0;
+	}
+
+	if (spillToDisk) {
+		for (auto it = states.begin(); it != end && freed < bytesToFree; ++it) {
+			if (!it->IsCompressed() || it->IsSpilled()) continue;
+			auto before = it->MemoryUsage();
+			if (!it->Spill()) {
+				spillToDisk = false;
+				break;
+			}
+			memoryUsage -= before;
+			memoryUsage += it->MemoryUsage();
+			diskUsage += it->DiskUsage();
+			freed += before - it->MemoryUsage();
+		}
+	}
+	return freed;
+}
+
 void FunscriptUndoSystem::ClearRedo() noexcept
 {
-	RedoStack.clear();
+	RedoStack.Clear();
+}
+
+size_t FunscriptUndoSystem::Compact(size_t bytesToFree, bool& spillToDisk) noexcept
+{
+	// redo states are only reachable after undoing everything above them
+	// so they get compacted before the undo stack
+	size_t freed = RedoStack.Compact(bytesToFree, spillToDisk);
+	if (freed < bytesToFree) {
+		freed += UndoStack.Compact(bytesToFree - freed, spillToDisk);
+	}
+	return freed;
 }
 
 void FunscriptUndoSystem::SnapshotRedo(int32_t type) noexcept
 {
-	RedoStack.emplace_back(std::move(ScriptState(type, script->Data())));
+	RedoStack.Push(type, script->Data());
 }
 
 void FunscriptUndoSystem::Snapshot(int32_t type, bool clearRedo) noexcept
 {
 	OFS_PROFILE(__FUNCTION__);
-	UndoStack.emplace_back(std::move(ScriptState(type, script->Data())));
+	UndoStack.Push(type, script->Data());
 
 	// redo gets cleared after every snapshot
 	if (clearRedo)
@@ -22,20 +363,22 @@ void FunscriptUndoSystem::Snapshot(int32_t type, bool clearRedo) noexcept
 
 bool FunscriptUndoSystem::Undo() noexcept
 {
-	if (UndoStack.empty()) return false;
+	if (UndoStack.Empty()) return false;
 	OFS_PROFILE(__FUNCTION__);
-	SnapshotRedo(UndoStack.back().type); // copy data to redo
-	script->Rollback(std::move(UndoStack.back().Data())); // move data
-	UndoStack.pop_back(); // pop of the stack
+	SnapshotRedo(UndoStack.Top().type); // copy data to redo
+	Funscript::FunscriptData data;
+	UndoStack.Pop(data); // pop of the stack
+	script->Rollback(std::move(data)); // move data
 	return true;
 }
 
 bool FunscriptUndoSystem::Redo() noexcept
 {
-	if (RedoStack.empty()) return false;
+	if (RedoStack.Empty()) return false;
 	OFS_PROFILE(__FUNCTION__);
-	Snapshot(RedoStack.back().type, false); // copy data to undo
-	script->Rollback(std::move(RedoStack.back().Data())); // move data
-	RedoStack.pop_back(); // pop of the stack
+	Snapshot(RedoStack.Top().type, false); // copy data to undo
+	Funscript::FunscriptData data;
+	RedoStack.Pop(data); // pop of the stack
+	script->Rollback(std::move(data)); // move data
 	return true;
-}
\ No newline at end of file
+}
@@ -2,19 +2,151 @@
 
 #include "Funscript.h"
 #include <vector>
+#include <string>
+#include <limits>
+
+// Describes how to get from a newer FunscriptArray to an older one.
+// Only the ranges which differ are stored.
+class FunscriptArrayDelta {
+private:
+	struct Hunk {
+		uint32_t index; // index into the newer array
+		uint32_t removeCount;
+		uint32_t insertOffset; // offset into inserts
+		uint32_t insertCount;
+
+		template<typename S>
+		void serialize(S& s)
+		{
+			s.value4b(index);
+			s.value4b(removeCount);
+			s.value4b(insertOffset);
+			s.value4b(insertCount);
+		}
+	};
+	std::vector<Hunk> hunks;
+	std::vector<FunscriptAction> inserts;
+public:
+	static FunscriptArrayDelta Diff(const FunscriptArray& newer, const FunscriptArray& older) noexcept;
+	void Apply(const FunscriptArray& newer, FunscriptArray& outOlder) const noexcept;
+
+	inline size_t MemoryUsage() const noexcept
+	{
+		return hunks.size() * sizeof(Hunk) + inserts.size() * sizeof(FunscriptAction);
+	}
+
+	template<typename S>
+	void serialize(S& s)
+	{
+		s.container(hunks, std::numeric_limits<uint32_t>::max());
+		s.container(inserts, std::numeric_limits<uint32_t>::max());
+	}
+};
+
+// Owns a file in the undo spill directory and removes it when destroyed.
+class UndoSpillFile {
+private:
+	std::string path;
+public:
+	UndoSpillFile() noexcept {}
+	~UndoSpillFile() noexcept { Remove(); }
+	UndoSpillFile(const UndoSpillFile&) = delete;
+	UndoSpillFile& operator=(const UndoSpillFile&) = delete;
+	UndoSpillFile(UndoSpillFile&& other) noexcept : path(std::move(other.path)) { other.path.clear(); }
+	UndoSpillFile& operator=(UndoSpillFile&& other) noexcept
+	{
+		if (this != &other) {
+			Remove();
+			path = std::move(other.path);
+			other.path.clear();
+		}
+		return *this;
+	}
+
+	// every process spills into its own directory below tmp/undo named after its id
+	static std::string Directory() noexcept;
+	// removes directories of processes which aren't running anymore
+	static void RemoveStaleDirectories() noexcept;
+	bool Write(const std::vector<uint8_t>& buffer) noexcept;
+	bool Read(std::vector<uint8_t>& buffer) noexcept;
+	void Remove() noexcept;
+	inline bool Empty() const noexcept { return path.empty(); }
+};
 
 class ScriptState {
 private:
+	// the top of a stack is always a full copy (keyframe)
+	// everything below it is stored as a delta to the state above
+	// unless the delta would be bigger than a full copy
 	Funscript::FunscriptData data;
+	FunscriptArrayDelta actionsDelta;
+	FunscriptArrayDelta selectionDelta;
+	bool keyframe = true;
+
+	// states which are far from the top can be compressed and spilled to disk
+	// when the undo memory budget is exceeded, see UndoSystem::EnforceMemoryBudget
+	std::vector<uint8_t> compressed;
+	uint32_t uncompressedSize = 0;
+	uint32_t compressedSize = 0;
+	UndoSpillFile spillFile;
+
+	// false if the state couldn't be read back, it's left empty in that case
+	bool restore() noexcept;
 public:
-	inline Funscript::FunscriptData& Data() { return data; }
 	int32_t type;
 	const char* Description() const noexcept;
 
-	ScriptState() noexcept 
+	ScriptState() noexcept
 		: type(-1) {}
 	ScriptState(int32_t type, const Funscript::FunscriptData& data) noexcept
 		: type(type), data(data) {}
+
+	inline bool IsKeyframe() const noexcept { return keyframe; }
+	inline bool IsCompressed() const noexcept { return uncompressedSize > 0; }
+	inline bool IsSpilled() const noexcept { return !spillFile.Empty(); }
+	inline Funscript::FunscriptData& Data() noexcept { FUN_ASSERT(keyframe && !IsCompressed(), "not a keyframe"); return data; }
+
+	void MakeDelta(const Funscript::FunscriptData& newer) noexcept;
+	bool MakeKeyframe(const Funscript::FunscriptData& newer) noexcept;
+	void Compress() noexcept;
+	bool Spill() noexcept;
+	// bytes held in memory, spilled states only count towards DiskUsage
+	size_t MemoryUsage() const noexcept;
+	inline size_t DiskUsage() const noexcept { return IsSpilled() ? compressedSize : 0; }
+
+	template<typename S>
+	void serialize(S& s)
+	{
+		s.value1b(keyframe);
+		s.container(data.Actions, std::numeric_limits<uint32_t>::max());
+		s.container(data.Selection, std::numeric_limits<uint32_t>::max());
+		s.object(actionsDelta);
+		s.object(selectionDelta);
+	}
+};
+
+class ScriptStateStack {
+private:
+	std::vector<ScriptState> states;
+	size_t memoryUsage = 0;
+	size_t diskUsage = 0;
+public:
+	ScriptStateStack(size_t reserve) noexcept { states.reserve(reserve); }
+
+	void Push(int32_t type, const Funscript::FunscriptData& data) noexcept;
+	// moves the top state into outData
+	void Pop(Funscript::FunscriptData& outData) noexcept;
+	void Clear() noexcept;
+	// compresses and optionally spills the oldest states until bytesToFree are freed
+	// the top is never touched, returns the amount of bytes freed
+	// spillToDisk is cleared if writing a spill file failed
+	size_t Compact(size_t bytesToFree, bool& spillToDisk) noexcept;
+
+	inline const ScriptState& Top() const noexcept { return states.back(); }
+	inline bool Empty() const noexcept { return states.empty(); }
+	inline size_t Size() const noexcept { return states.size(); }
+	inline size_t MemoryUsage() const noexcept { return memoryUsage; }
+	inline size_t DiskUsage() const noexcept { return diskUsage; }
 };
 
 class FunscriptUndoSystem
@@ -23,22 +155,24 @@ class FunscriptUndoSystem
 
 	Funscript* script = nullptr;
 	void SnapshotRedo(int32_t type) noexcept;
-	
-	std::vector<ScriptState> UndoStack;
-	std::vector<ScriptState> RedoStack;
+
+	ScriptStateStack UndoStack;
+	ScriptStateStack RedoStack;
 
 	void Snapshot(int32_t type, bool clearRedo = true) noexcept;
 	bool Undo() noexcept;
 	bool Redo() noexcept;
 	void ClearRedo() noexcept;
+	size_t Compact(size_t bytesToFree, bool& spillToDisk) noexcept;
 public:
-	FunscriptUndoSystem(Funscript* script) : script(script) {
+	FunscriptUndoSystem(Funscript* script)
+		: script(script), UndoStack(1000), RedoStack(100) {
 		FUN_ASSERT(script != nullptr, "no script");
-		UndoStack.reserve(1000);
-		RedoStack.reserve(100);
 	}
 
-	inline bool MatchUndoTop(int32_t type) const noexcept { return !UndoEmpty() && UndoStack.back().type == type; }
-	inline bool UndoEmpty() const noexcept { return UndoStack.empty(); }
-	inline bool RedoEmpty() const noexcept { return RedoStack.empty(); }
+	inline bool MatchUndoTop(int32_t type) const noexcept { return !UndoEmpty() && UndoStack.Top().type == type; }
+	inline bool UndoEmpty() const noexcept { return UndoStack.Empty(); }
+	inline bool RedoEmpty() const noexcept { return RedoStack.Empty(); }
+	inline size_t MemoryUsage() const noexcept { return UndoStack.MemoryUsage() + RedoStack.MemoryUsage(); }
+	inline size_t DiskUsage() const noexcept { return UndoStack.DiskUsage() + RedoStack.DiskUsage(); }
 };
@@ -10,14 +10,44 @@
 
 #include <vector>
 #include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <memory>
+#include <limits>
 
 #include "OFS_Profiling.h"
 
+#include "sdefl.h"
+#include "sinfl.h"
+
 
 #include "OFS_VectorSet.h"
+#include "OFS_ChunkedSet.h"
+
+// Non owning input buffer, used to deserialize straight out of memory mapped files.
+struct ByteView {
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+};
 
 namespace bitsery {
     namespace traits {
+        // ByteView
+        template<>
+        struct ContainerTraits<ByteView> {
+            using TValue = uint8_t;
+            static constexpr bool isResizable = false;
+            static constexpr bool isContiguous = true;
+            static size_t size(const ByteView& view) { return view.size; }
+        };
+
+        template<>
+        struct BufferAdapterTraits<ByteView> {
+            using TIterator = const uint8_t*;
+            using TConstIterator = const uint8_t*;
+            using TValue = uint8_t;
+        };
+
         // vector_set
         template<typename T, typename Allocator>
         struct ContainerTraits<vector_set<T, Allocator>>
@@ -28,6 +58,12 @@ namespace bitsery {
         struct BufferAdapterTraits<vector_set<T, Allocator>>
         : public StdContainerForBufferAdapter<vector_set<T, Allocator>> {
         };
+
+        // chunked_set
+        template<typename T, typename Comparison, size_t ChunkCapacity>
+        struct ContainerTraits<chunked_set<T, Comparison, ChunkCapacity>>
+        : public StdContainer<chunked_set<T, Comparison, ChunkCapacity>, true, false> {
+        };
     }
 }
 
@@ -40,6 +76,8 @@ using TContext = std::tuple<bitsery::ext::PointerLinkingContext>;
 
 using ContextSerializer = bitsery::Serializer<OutputAdapter, TContext>;
 using ContextDeserializer = bitsery::Deserializer<InputAdapter, TContext>;
+using ViewInputAdapter = bitsery::InputBufferAdapter<ByteView>;
+using ViewContextDeserializer = bitsery::Deserializer<ViewInputAdapter, TContext>;
 
 struct OFS_Binary {
 
@@ -71,8 +109,302 @@ struct OFS_Binary {
 
         return error;
     }
+
+    template<typename T>
+    static auto Deserialize(ByteView view, T& obj) noexcept
+    {
+        OFS_PROFILE(__FUNCTION__);
+        TContext ctx{};
+        ViewContextDeserializer des{ ctx, view.data, view.size };
+        des.object(obj);
+
+        auto error = des.adapter().error();
+        std::get<0>(ctx).clearSharedState();
+
+        return error;
+    }
+};
+
+// Compact encoding for sorted action arrays like FunscriptArray.
+// Layout: version | time mode | flags | varint count | [varint raw size, u32 checksum if deflated] | payload
+// Every action in the payload is a varint time delta followed by the position in 7 bits.
+// If the high bit of the position byte is set the full pos, flags & tag follow.
+struct OFS_ActionEncoding {
+    static constexpr uint8_t Version = 1;
+
+    enum TimeMode : uint8_t {
+        RawTime = 0, // 4 bytes float per action
+        MillisecondTime = 1, // delta in integer milliseconds, every time round trips through at / 1000.0
+        FloatBitsTime = 2, // delta of the float bit patterns, those are monotonic for positive floats
+    };
+    static constexpr uint8_t DeflatedFlag = 0x1;
+    // payloads smaller than this aren't worth the compressor
+    static constexpr size_t MinDeflateSize = 256;
+
+    inline static void writeVarint(ByteBuffer& out, uint64_t value) noexcept
+    {
+        while (value >= 0x80) {
+            out.push_back((uint8_t)(value | 0x80));
+            value >>= 7;
+        }
+        out.push_back((uint8_t)value);
+    }
+
+    inline static bool readVarint(const uint8_t*& it, const uint8_t* end, uint64_t& value) noexcept
+    {
+        value = 0;
+        for (uint32_t shift = 0; it != end && shift < 64; shift += 7) {
+            uint8_t byte = *it++;
+            value |= (uint64_t)(byte & 0x7F) << shift;
+            if (!(byte & 0x80)) return true;
+        }
+        return false;
+    }
+
+    // sinflate trusts its input, the checksum over header and deflated data keeps corrupted files away from it
+    inline static uint32_t checksum(const uint8_t* data, size_t size, uint32_t hash = 2166136261u) noexcept
+    {
+        // FNV-1a
+        for (size_t i = 0; i < size; i += 1) {
+            hash = (hash ^ data[i]) * 16777619u;
+        }
+        return hash;
+    }
+
+    inline static uint32_t floatBits(float value) noexcept
+    {
+        uint32_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        return bits;
+    }
+
+    inline static float bitsFloat(uint32_t bits) noexcept
+    {
+        float value;
+        memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+    inline static int64_t toMilliseconds(float atS) noexcept
+    {
+        return std::llround((double)atS * 1000.0);
+    }
+
+    inline static float fromMilliseconds(int64_t ms) noexcept
+    {
+        // same as Funscript::Deserialize
+        return (float)(ms / 1000.0);
+    }
+
+    template<typename Container>
+    static TimeMode chooseTimeMode(const Container& actions) noexcept
+    {
+        bool milliseconds = true;
+        bool monotonicBits = true;
+        int64_t lastMs = 0;
+        uint32_t lastBits = 0;
+        for (auto& action : actions) {
+            if (!(action.atS >= 0.f) || std::signbit(action.atS)) return RawTime;
+            auto bits = floatBits(action.atS);
+            monotonicBits = monotonicBits && bits >= lastBits;
+            lastBits = bits;
+            if (milliseconds) {
+                auto ms = toMilliseconds(action.atS);
+                milliseconds = ms >= lastMs && fromMilliseconds(ms) == action.atS;
+                lastMs = ms;
+            }
+        }
+        return milliseconds ? MillisecondTime : monotonicBits ? FloatBitsTime : RawTime;
+    }
+
+    template<typename Container>
+    static void Encode(const Container& actions, ByteBuffer& out) noexcept
+    {
+        OFS_PROFILE(__FUNCTION__);
+        auto timeMode = chooseTimeMode(actions);
+        ByteBuffer payload;
+        payload.reserve(actions.size() * 3);
+        int64_t lastMs = 0;
+        uint32_t lastBits = 0;
+        for (auto& action : actions) {
+            switch (timeMode) {
+                case MillisecondTime: {
+                    auto ms = toMilliseconds(action.atS);
+                    writeVarint(payload, (uint64_t)(ms - lastMs));
+                    lastMs = ms;
+                    break;
+                }
+                case FloatBitsTime: {
+                    auto bits = floatBits(action.atS);
+                    writeVarint(payload, bits - lastBits);
+                    lastBits = bits;
+                    break;
+                }
+                default: {
+                    auto bits = floatBits(action.atS);
+                    for (int i = 0; i < 4; i += 1) payload.push_back((uint8_t)(bits >> (i * 8)));
+                    break;
+                }
+            }
+            if (action.pos >= 0 && action.pos <= 0x7F && action.flags == 0 && action.tag == 0) {
+                payload.push_back((uint8_t)action.pos);
+            }
+            else {
+                payload.push_back(0x80);
+                payload.push_back((uint8_t)((uint16_t)action.pos & 0xFF));
+                payload.push_back((uint8_t)((uint16_t)action.pos >> 8));
+                payload.push_back(action.flags);
+                payload.push_back(action.tag);
+            }
+        }
+
+        out.clear();
+        out.push_back(Version);
+        out.push_back(timeMode);
+        if (payload.size() >= MinDeflateSize) {
+            // the context is too big for the stack
+            auto ctx = std::make_unique<sdefl>();
+            ByteBuffer deflated;
+            deflated.resize(sdefl_bound(payload.size()));
+            auto deflatedSize = sdeflate(ctx.get(), deflated.data(), payload.data(), payload.size(), SDEFL_LVL_DEF);
+            if (deflatedSize > 0 && (size_t)deflatedSize < payload.size()) {
+                out.push_back(DeflatedFlag);
+                writeVarint(out, actions.size());
+                writeVarint(out, payload.size());
+                auto hash = checksum(deflated.data(), deflatedSize, checksum(out.data(), out.size()));
+                for (int i = 0; i < 4; i += 1) out.push_back((uint8_t)(hash >> (i * 8)));
+                out.insert(out.end(), deflated.begin(), deflated.begin() + deflatedSize);
+                return;
+            }
+        }
+        out.push_back(0);
+        writeVarint(out, actions.size());
+        out.insert(out.end(), payload.begin(), payload.end());
+    }
+
+    template<typename Container>
+    static bool Decode(const uint8_t* data, size_t size, Container& outActions) noexcept
+    {
+        OFS_PROFILE(__FUNCTION__);
+        using Action = typename Container::value_type;
+        const uint8_t* it = data;
+        const uint8_t* end = data + size;
+        if (size < 3 || it[0] > Version) return false;
+        auto timeMode = (TimeMode)it[1];
+        uint8_t flags = it[2];
+        it += 3;
+
+        uint64_t count;
+        if (!readVarint(it, end, count)) return false;
+
+        ByteBuffer inflated;
+        if (flags & DeflatedFlag) {
+            uint64_t rawSize;
+            // an action takes 2 to 15 bytes
+            if (!readVarint(it, end, rawSize) || rawSize > std::numeric_limits<uint32_t>::max()
+                || count > rawSize / 2 || rawSize > count * 15 || end - it < 4) return false;
+            uint32_t hash = it[0] | (it[1] << 8) | (it[2] << 16) | ((uint32_t)it[3] << 24);
+            auto headerHash = checksum(data, it - data);
+            it += 4;
+            if (checksum(it, end - it, headerHash) != hash) return false;
+            // sinflate reads up to 8 bytes past the input
+            ByteBuffer deflated(it, end);
+            deflated.resize(deflated.size() + 8);
+            inflated.resize(rawSize);
+            auto inflatedSize = sinflate(inflated.data(), (int)inflated.size(), deflated.data(), (int)(end - it));
+            if (inflatedSize != (int)rawSize) return false;
+            it = inflated.data();
+            end = inflated.data() + inflated.size();
+        }
+        else if (count > (uint64_t)(end - it)) {
+            return false;
+        }
+
+        outActions.clear();
+        outActions.reserve(count);
+        int64_t lastMs = 0;
+        uint32_t lastBits = 0;
+        for (uint64_t i = 0; i < count; i += 1) {
+            Action action;
+            uint64_t delta;
+            switch (timeMode) {
+                case MillisecondTime:
+                    if (!readVarint(it, end, delta)) return false;
+                    lastMs += (int64_t)delta;
+                    action.atS = fromMilliseconds(lastMs);
+                    break;
+                case FloatBitsTime:
+                    if (!readVarint(it, end, delta)) return false;
+                    lastBits += (uint32_t)delta;
+                    action.atS = bitsFloat(lastBits);
+                    break;
+                case RawTime: {
+                    if (end - it < 4) return false;
+                    uint32_t bits = it[0] | (it[1] << 8) | (it[2] << 16) | ((uint32_t)it[3] << 24);
+                    action.atS = bitsFloat(bits);
+                    it += 4;
+                    break;
+                }
+                default:
+                    return false;
+            }
+            if (it == end) return false;
+            uint8_t pos = *it++;
+            if (pos & 0x80) {
+                if (end - it < 4) return false;
+                action.pos = (int16_t)(uint16_t)(it[0] | (it[1] << 8));
+                action.flags = it[2];
+                action.tag = it[3];
+                it += 4;
+            }
+            else {
+                action.pos = pos;
+                action.flags = 0;
+                action.tag = 0;
+            }
+            outActions.emplace_back_unsorted(action);
+        }
+        return it == end;
+    }
 };
 
+namespace bitsery {
+    namespace ext {
+        // Writes a sorted action array with OFS_ActionEncoding instead of one action at a time.
+        // An empty blob leaves the array untouched, that's what old data inside a Growable reads as.
+        class CompactActions {
+        public:
+            template<typename Ser, typename T, typename Fnc>
+            void serialize(Ser& ser, const T& obj, Fnc&&) const
+            {
+                ByteBuffer encoded;
+                OFS_ActionEncoding::Encode(obj, encoded);
+                ser.container1b(encoded, std::numeric_limits<uint32_t>::max());
+            }
+
+            template<typename Des, typename T, typename Fnc>
+            void deserialize(Des& des, T& obj, Fnc&&) const
+            {
+                ByteBuffer encoded;
+                des.container1b(encoded, std::numeric_limits<uint32_t>::max());
+                if (!encoded.empty() && !OFS_ActionEncoding::Decode(encoded.data(), encoded.size(), obj)) {
+                    des.adapter().error(ReaderError::InvalidData);
+                }
+            }
+        };
+    }
+
+    namespace traits {
+        template<typename T>
+        struct ExtensionTraits<ext::CompactActions, T> {
+            using TValue = void;
+            static constexpr bool SupportValueOverload = false;
+            static constexpr bool SupportObjectOverload = true;
+            static constexpr bool SupportLambdaOverload = false;
+        };
+    }
+}
+
 #include "imgui.h"
 
 namespace bitsery {
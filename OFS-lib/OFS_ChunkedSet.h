@@ -0,0 +1,430 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <type_traits>
+#include <vector>
+
+#include "OFS_VectorSet.h"
+
+// Sorted set stored as a list of sorted chunks.
+// Has the same interface as vector_set but inserting/erasing only moves
+// the elements of a single chunk instead of the whole tail of the array.
+// Iterators are random access, positional access is O(log(chunk count)).
+template<typename T, typename Comparison = DefaultComparison<T>, size_t ChunkCapacity = 1024>
+class chunked_set {
+    static_assert(ChunkCapacity >= 4, "chunk capacity too small");
+public:
+    using value_type = T;
+    using size_type = size_t;
+    using difference_type = std::ptrdiff_t;
+    using reference = T&;
+    using const_reference = const T&;
+
+private:
+    using Chunk = std::vector<T>;
+
+    // invariant: no chunk is ever empty
+    std::vector<Chunk> chunks;
+    // global index of the first element of every chunk
+    std::vector<size_t> starts;
+    size_t count = 0;
+
+    static inline bool less(const T& a, const T& b) noexcept
+    {
+        Comparison comp;
+        return comp(a, b);
+    }
+
+    inline size_t chunkForIndex(size_t idx) const noexcept
+    {
+        auto it = std::upper_bound(starts.begin(), starts.end(), idx);
+        return std::distance(starts.begin(), it) - 1;
+    }
+
+    // first chunk which could contain a value not less than a
+    inline size_t chunkForValue(const T& a) const noexcept
+    {
+        auto it = std::lower_bound(chunks.begin(), chunks.end(), a,
+            [](const Chunk& c, const T& v) noexcept {
+                return less(c.back(), v);
+            });
+        return std::distance(chunks.begin(), it);
+    }
+
+    inline void updateStarts(size_t fromChunk) noexcept
+    {
+        starts.resize(chunks.size());
+        size_t start = fromChunk > 0 ? starts[fromChunk - 1] + chunks[fromChunk - 1].size() : 0;
+        for (size_t i = fromChunk, size = chunks.size(); i < size; ++i) {
+            starts[i] = start;
+            start += chunks[i].size();
+        }
+    }
+
+    inline void splitChunk(size_t chunkIdx) noexcept
+    {
+        auto& full = chunks[chunkIdx];
+        auto half = full.size() / 2;
+        Chunk upper;
+        upper.reserve(ChunkCapacity);
+        upper.assign(full.begin() + half, full.end());
+        full.erase(full.begin() + half, full.end());
+        chunks.insert(chunks.begin() + chunkIdx + 1, std::move(upper));
+        starts.insert(starts.begin() + chunkIdx + 1, starts[chunkIdx] + half);
+    }
+
+    inline void removeEmptyChunks(size_t fromChunk) noexcept
+    {
+        chunks.erase(std::remove_if(chunks.begin() + fromChunk, chunks.end(),
+            [](const Chunk& c) noexcept { return c.empty(); }), chunks.end());
+        updateStarts(fromChunk);
+    }
+
+    // rebuilds chunks from a flat array filling them halfway to leave room for inserts
+    inline void rebuild(const T* values, size_t size) noexcept
+    {
+        chunks.clear();
+        constexpr size_t fill = ChunkCapacity / 2;
+        chunks.reserve(size / fill + 1);
+        for (size_t i = 0; i < size; i += fill) {
+            auto& chunk = chunks.emplace_back();
+            chunk.reserve(ChunkCapacity);
+            chunk.assign(values + i, values + std::min(size, i + fill));
+        }
+        count = size;
+        updateStarts(0);
+    }
+
+    inline std::vector<T> flatten() const noexcept
+    {
+        std::vector<T> flat;
+        flat.reserve(count);
+        for (auto& chunk : chunks) {
+            flat.insert(flat.end(), chunk.begin(), chunk.end());
+        }
+        return flat;
+    }
+
+public:
+    template<bool IsConst>
+    class basic_iterator {
+        friend class chunked_set;
+        using Container = std::conditional_t<IsConst, const chunked_set, chunked_set>;
+
+        Container* set = nullptr;
+        size_t chunk = 0;
+        size_t offset = 0;
+
+        basic_iterator(Container* set, size_t chunk, size_t offset) noexcept
+            : set(set), chunk(chunk), offset(offset) {}
+
+        inline size_t index() const noexcept
+        {
+            return chunk < set->chunks.size() ? set->starts[chunk] + offset : set->count;
+        }
+    public:
+        using iterator_category = std::random_access_iterator_tag;
+        using value_type = T;
+        using difference_type = std::ptrdiff_t;
+        using pointer = std::conditional_t<IsConst, const T*, T*>;
+        using reference = std::conditional_t<IsConst, const T&, T&>;
+
+        basic_iterator() noexcept = default;
+
+        template<bool C = IsConst, typename = std::enable_if_t<C>>
+        basic_iterator(const basic_iterator<false>& it) noexcept
+            : set(it.set), chunk(it.chunk), offset(it.offset) {}
+
+        inline reference operator*() const noexcept { return set->chunks[chunk][offset]; }
+        inline pointer operator->() const noexcept { return &set->chunks[chunk][offset]; }
+        inline reference operator[](difference_type n) const noexcept { return *(*this + n); }
+
+        inline basic_iterator& operator++() noexcept
+        {
+            if (++offset == set->chunks[chunk].size()) {
+                ++chunk;
+                offset = 0;
+            }
+            return *this;
+        }
+
+        inline basic_iterator& operator--() noexcept
+        {
+            if (offset == 0) {
+                --chunk;
+                offset = set->chunks[chunk].size();
+            }
+            --offset;
+            return *this;
+        }
+
+        inline basic_iterator operator++(int) noexcept { auto tmp = *this; ++*this; return tmp; }
+        inline basic_iterator operator--(int) noexcept { auto tmp = *this; --*this; return tmp; }
+
+        inline basic_iterator& operator+=(difference_type n) noexcept
+        {
+            if (n >= 0 && chunk < set->chunks.size() && offset + n < set->chunks[chunk].size()) {
+                offset += n;
+            }
+            else if (n < 0 && offset >= (size_t)-n) {
+                offset += n;
+            }
+            else {
+                *this = set->iteratorAt(index() + n);
+            }
+            return *this;
+        }
+
+        inline basic_iterator& operator-=(difference_type n) noexcept { return *this += -n; }
+        inline basic_iterator operator+(difference_type n) const noexcept { auto tmp = *this; return tmp += n; }
+        inline basic_iterator operator-(difference_type n) const noexcept { auto tmp = *this; return tmp -= n; }
+        friend inline basic_iterator operator+(difference_type n, const basic_iterator& it) noexcept { return it + n; }
+
+        template<bool C>
+        inline difference_type operator-(const basic_iterator<C>& b) const noexcept
+        {
+            return (difference_type)index() - (difference_type)b.index();
+        }
+
+        template<bool C>
+        inline bool operator==(const basic_iterator<C>& b) const noexcept { return chunk == b.chunk && offset == b.offset; }
+        template<bool C>
+        inline bool operator!=(const basic_iterator<C>& b) const noexcept { return !(*this == b); }
+        template<bool C>
+        inline bool operator<(const basic_iterator<C>& b) const noexcept { return chunk < b.chunk || (chunk == b.chunk && offset < b.offset); }
+        template<bool C>
+        inline bool operator>(const basic_iterator<C>& b) const noexcept { return b < *this; }
+        template<bool C>
+        inline bool operator<=(const basic_iterator<C>& b) const noexcept { return !(b < *this); }
+        template<bool C>
+        inline bool operator>=(const basic_iterator<C>& b) const noexcept { return !(*this < b); }
+
+        template<bool> friend class basic_iterator;
+    };
+
+    using iterator = basic_iterator<false>;
+    using const_iterator = basic_iterator<true>;
+
+    inline iterator iteratorAt(size_t idx) noexcept
+    {
+        if (idx >= count) return end();
+        auto chunkIdx = chunkForIndex(idx);
+        return iterator(this, chunkIdx, idx - starts[chunkIdx]);
+    }
+
+    inline const_iterator iteratorAt(size_t idx) const noexcept
+    {
+        if (idx >= count) return cend();
+        auto chunkIdx = chunkForIndex(idx);
+        return const_iterator(this, chunkIdx, idx - starts[chunkIdx]);
+    }
+
+    inline iterator begin() noexcept { return iterator(this, 0, 0); }
+    inline iterator end() noexcept { return iterator(this, chunks.size(), 0); }
+    inline const_iterator begin() const noexcept { return const_iterator(this, 0, 0); }
+    inline const_iterator end() const noexcept { return const_iterator(this, chunks.size(), 0); }
+    inline const_iterator cbegin() const noexcept { return begin(); }
+    inline const_iterator cend() const noexcept { return end(); }
+
+    inline size_t size() const noexcept { return count; }
+    inline bool empty() const noexcept { return count == 0; }
+    inline size_t max_size() const noexcept { return std::vector<T>().max_size(); }
+    inline size_t chunk_count() const noexcept { return chunks.size(); }
+
+    inline void reserve(size_t size) noexcept { chunks.reserve(size / (ChunkCapacity / 2) + 1); }
+
+    inline void clear() noexcept
+    {
+        chunks.clear();
+        starts.clear();
+        count = 0;
+    }
+
+    inline T& operator[](size_t idx) noexcept { return *iteratorAt(idx); }
+    inline const T& operator[](size_t idx) const noexcept { return *iteratorAt(idx); }
+    inline T& front() noexcept { return chunks.front().front(); }
+    inline const T& front() const noexcept { return chunks.front().front(); }
+    inline T& back() noexcept { return chunks.back().back(); }
+    inline const T& back() const noexcept { return chunks.back().back(); }
+
+    inline void sort() noexcept
+    {
+        auto flat = flatten();
+        std::sort(flat.begin(), flat.end());
+        rebuild(flat.data(), flat.size());
+    }
+
+    inline void resize(size_t size) noexcept
+    {
+        auto flat = flatten();
+        flat.resize(size);
+        rebuild(flat.data(), flat.size());
+    }
+
+    template<typename InputIt>
+    inline void assign(InputIt first, InputIt last) noexcept
+    {
+        std::vector<T> flat(first, last);
+        rebuild(flat.data(), flat.size());
+    }
+
+    // inserts a sorted range with a single linear merge instead of one insert per value
+    template<typename InputIt>
+    inline void merge(InputIt first, InputIt last) noexcept
+    {
+        std::vector<T> merged;
+        merged.reserve(count + std::distance(first, last));
+        merge_unique<Comparison>(cbegin(), cend(), first, last, merged);
+        rebuild(merged.data(), merged.size());
+    }
+
+    template<typename... Args>
+    inline bool emplace(Args&&... args) noexcept
+    {
+        T obj(std::forward<Args>(args)...);
+        if (chunks.empty()) {
+            emplace_back_unsorted(obj);
+            return true;
+        }
+
+        auto chunkIdx = std::min(chunkForValue(obj), chunks.size() - 1);
+        auto& chunk = chunks[chunkIdx];
+        auto it = std::lower_bound(chunk.begin(), chunk.end(), obj,
+            [](const T& a, const T& b) noexcept { return less(a, b); });
+
+        if (it != chunk.end() && !less(*it, obj) && !less(obj, *it)) {
+            return false;
+        }
+
+        chunk.insert(it, std::move(obj));
+        ++count;
+        for (size_t i = chunkIdx + 1, size = starts.size(); i < size; ++i) {
+            ++starts[i];
+        }
+        if (chunk.size() > ChunkCapacity) {
+            splitChunk(chunkIdx);
+        }
+        return true;
+    }
+
+    // calls fn(T* values, size_t count) once per chunk
+    // fn must not change the order of the values
+    template<typename Fn>
+    inline void for_each_span(Fn&& fn) noexcept
+    {
+        for (auto& chunk : chunks) fn(chunk.data(), chunk.size());
+    }
+
+    template<typename Fn>
+    inline void for_each_span(Fn&& fn) const noexcept
+    {
+        for (auto& chunk : chunks) fn(chunk.data(), chunk.size());
+    }
+
+    inline void emplace_back_unsorted(const T& a) noexcept
+    {
+        if (chunks.empty() || chunks.back().size() >= ChunkCapacity) {
+            chunks.emplace_back().reserve(ChunkCapacity);
+            starts.emplace_back(count);
+        }
+        chunks.back().emplace_back(a);
+        ++count;
+    }
+
+    inline iterator erase(const_iterator pos) noexcept
+    {
+        auto idx = pos.index();
+        auto& chunk = chunks[pos.chunk];
+        chunk.erase(chunk.begin() + pos.offset);
+        --count;
+        if (chunk.empty()) {
+            chunks.erase(chunks.begin() + pos.chunk);
+            starts.erase(starts.begin() + pos.chunk);
+        }
+        for (size_t i = pos.chunk, size = starts.size(); i < size; ++i) {
+            if (starts[i] > idx) --starts[i];
+        }
+        return iteratorAt(idx);
+    }
+
+    inline iterator erase(const_iterator first, const_iterator last) noexcept
+    {
+        if (first == last) return iteratorAt(first.index());
+        auto firstIdx = first.index();
+        auto lastIdx = last.index();
+
+        for (size_t c = first.chunk; c < chunks.size() && starts[c] < lastIdx; ++c) {
+            auto& chunk = chunks[c];
+            size_t from = firstIdx > starts[c] ? firstIdx - starts[c] : 0;
+            size_t to = std::min(chunk.size(), lastIdx - starts[c]);
+            chunk.erase(chunk.begin() + from, chunk.begin() + to);
+        }
+        count -= lastIdx - firstIdx;
+        removeEmptyChunks(first.chunk);
+        return iteratorAt(firstIdx);
+    }
+
+    inline auto find(const T& a) noexcept
+    {
+        auto it = lower_bound(a);
+        if (it != end() && *it == a) {
+            return it;
+        }
+        return end();
+    }
+
+    inline auto find(const T& a) const noexcept
+    {
+        auto it = lower_bound(a);
+        if (it != cend() && *it == a) {
+            return it;
+        }
+        return cend();
+    }
+
+    inline iterator lower_bound(const T& a) noexcept
+    {
+        auto chunkIdx = chunkForValue(a);
+        if (chunkIdx == chunks.size()) return end();
+        auto& chunk = chunks[chunkIdx];
+        auto it = std::lower_bound(chunk.begin(), chunk.end(), a,
+            [](const T& a, const T& b) noexcept { return less(a, b); });
+        return iterator(this, chunkIdx, std::distance(chunk.begin(), it));
+    }
+
+    inline const_iterator lower_bound(const T& a) const noexcept
+    {
+        auto chunkIdx = chunkForValue(a);
+        if (chunkIdx == chunks.size()) return end();
+        auto& chunk = chunks[chunkIdx];
+        auto it = std::lower_bound(chunk.begin(), chunk.end(), a,
+            [](const T& a, const T& b) noexcept { return less(a, b); });
+        return const_iterator(this, chunkIdx, std::distance(chunk.begin(), it));
+    }
+
+    inline iterator upper_bound(const T& a) noexcept
+    {
+        auto it = std::upper_bound(chunks.begin(), chunks.end(), a,
+            [](const T& v, const Chunk& c) noexcept { return less(v, c.back()); });
+        auto chunkIdx = (size_t)std::distance(chunks.begin(), it);
+        if (chunkIdx == chunks.size()) return end();
+        auto& chunk = chunks[chunkIdx];
+        auto elemIt = std::upper_bound(chunk.begin(), chunk.end(), a,
+            [](const T& a, const T& b) noexcept { return less(a, b); });
+        return iterator(this, chunkIdx, std::distance(chunk.begin(), elemIt));
+    }
+
+    inline const_iterator upper_bound(const T& a) const noexcept
+    {
+        auto it = std::upper_bound(chunks.begin(), chunks.end(), a,
+            [](const T& v, const Chunk& c) noexcept { return less(v, c.back()); });
+        auto chunkIdx = (size_t)std::distance(chunks.begin(), it);
+        if (chunkIdx == chunks.size()) return end();
+        auto& chunk = chunks[chunkIdx];
+        auto elemIt = std::upper_bound(chunk.begin(), chunk.end(), a,
+            [](const T& a, const T& b) noexcept { return less(a, b); });
+        return const_iterator(this, chunkIdx, std::distance(chunk.begin(), elemIt));
+    }
+};
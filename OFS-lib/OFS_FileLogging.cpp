@@ -66,13 +66,13 @@ static int LogThreadFunction(void* threadData) noexcept
     return 0;
 }
 
-void OFS_FileLogger::Init() noexcept
+void OFS_FileLogger::Init(const char* fileName) noexcept
 {
     if (LogFileHandle) return;
 #ifndef NDEBUG
     SDL_LogSetAllPriority(SDL_LOG_PRIORITY_VERBOSE);
 #endif
-    auto LogFilePath = Util::Prefpath("OFS.log");
+    auto LogFilePath = Util::Prefpath(fileName);
     LogFileHandle = SDL_RWFromFile(LogFilePath.c_str(), "w");
 
     Thread.Init();
@@ -14,7 +14,8 @@ public:
     static constexpr int MaxLogThreads = 1;
     static struct SDL_RWops* LogFileHandle;
 
-    static void Init() noexcept;
+    // the file is truncated, fileName is relative to the pref path
+    static void Init(const char* fileName = "OFS.log") noexcept;
     static void Shutdown() noexcept;
 
     static void Flush() noexcept;
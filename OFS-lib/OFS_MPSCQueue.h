@@ -0,0 +1,108 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+// Bounded lock-free queue for many producers and a single consumer.
+// Every slot carries a sequence number which tells producers and the consumer
+// whose turn it is, a producer claims a slot with a single CAS.
+// Values are move assigned into preallocated slots, pushing never allocates.
+template<typename T, size_t Capacity>
+class mpsc_queue {
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "capacity has to be a power of two");
+public:
+    using value_type = T;
+    using size_type = size_t;
+
+private:
+    static constexpr size_t Mask = Capacity - 1;
+
+    struct Slot {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    std::unique_ptr<Slot[]> slots;
+    // producers & the consumer each get their own cache line
+    alignas(64) std::atomic<size_t> enqueuePos;
+    alignas(64) std::atomic<size_t> dequeuePos;
+
+public:
+    mpsc_queue() noexcept
+        : slots(new Slot[Capacity]), enqueuePos(0), dequeuePos(0)
+    {
+        for (size_t i = 0; i < Capacity; i += 1) {
+            slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+    mpsc_queue(const mpsc_queue&) = delete;
+    mpsc_queue& operator=(const mpsc_queue&) = delete;
+
+    // returns false if the queue is full, safe to call from any thread
+    template<typename U>
+    bool try_push(U&& value) noexcept
+    {
+        size_t pos = enqueuePos.load(std::memory_order_relaxed);
+        for (;;) {
+            Slot& slot = slots[pos & Mask];
+            size_t sequence = slot.sequence.load(std::memory_order_acquire);
+            auto diff = (intptr_t)sequence - (intptr_t)pos;
+            if (diff == 0) {
+                if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    slot.value = std::forward<U>(value);
+                    slot.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff < 0) {
+                // the consumer didn't get to this slot yet
+                return false;
+            }
+            else {
+                pos = enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // returns false if the queue is empty, only call this from the consumer thread
+    bool try_pop(T& out) noexcept
+    {
+        size_t pos = dequeuePos.load(std::memory_order_relaxed);
+        Slot& slot = slots[pos & Mask];
+        size_t sequence = slot.sequence.load(std::memory_order_acquire);
+        // also false while a producer is still writing the slot
+        if ((intptr_t)sequence - (intptr_t)(pos + 1) < 0) return false;
+        out = std::move(slot.value);
+        slot.sequence.store(pos + Capacity, std::memory_order_release);
+        dequeuePos.store(pos + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    // moves everything that's ready into out, returns how many were added
+    template<typename Container>
+    size_t pop_all(Container& out) noexcept
+    {
+        size_t count = 0;
+        for (;;) {
+            auto& value = out.emplace_back();
+            if (!try_pop(value)) {
+                out.pop_back();
+                return count;
+            }
+            count += 1;
+        }
+    }
+
+    // only a snapshot if other threads are pushing or popping
+    inline size_t size() const noexcept
+    {
+        size_t enqueued = enqueuePos.load(std::memory_order_relaxed);
+        size_t dequeued = dequeuePos.load(std::memory_order_relaxed);
+        return enqueued > dequeued ? enqueued - dequeued : 0;
+    }
+    inline bool empty() const noexcept { return size() == 0; }
+    static constexpr size_t capacity() noexcept { return Capacity; }
+};
@@ -0,0 +1,14 @@
+#pragma once
+
+// OFS_AVX comes from the build (option OFS_AVX), OFS_SSE2 is derived from the compiler target.
+// Code using intrinsics includes this instead of checking the compiler macros itself
+// and keeps a plain loop for OFS_SSE2 == 0.
+#if OFS_AVX
+#include <immintrin.h>
+#define OFS_SSE2 1
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define OFS_SSE2 1
+#else
+#define OFS_SSE2 0
+#endif
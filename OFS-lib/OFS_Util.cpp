@@ -13,6 +13,10 @@
 #define WIN32_LEAN_AND_MEAN
 #include <Windows.h>
 #include <shellapi.h>
+#else
+#include <signal.h>
+#include <unistd.h>
+#include <cerrno>
 #endif
 
 #define STB_IMAGE_WRITE_IMPLEMENTATION
@@ -362,6 +366,30 @@ std::filesystem::path Util::FfmpegPath() noexcept
 #endif
 }
 
+uint32_t Util::ProcessId() noexcept
+{
+#if WIN32
+    return GetCurrentProcessId();
+#else
+    return getpid();
+#endif
+}
+
+bool Util::ProcessRunning(uint32_t pid) noexcept
+{
+#if WIN32
+    HANDLE process = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, pid);
+    if (!process) return GetLastError() == ERROR_ACCESS_DENIED;
+    DWORD exitCode = 0;
+    bool running = GetExitCodeProcess(process, &exitCode) && exitCode == STILL_ACTIVE;
+    CloseHandle(process);
+    return running;
+#else
+    // EPERM means it exists but belongs to someone else
+    return kill((pid_t)pid, 0) == 0 || errno == EPERM;
+#endif
+}
+
 static rnd_pcg_t pcg;
 void Util::InitRandom() noexcept
 {
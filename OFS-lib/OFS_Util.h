@@ -471,6 +471,10 @@ public:
 
     static std::filesystem::path FfmpegPath() noexcept;
 
+    static uint32_t ProcessId() noexcept;
+    // false if no process with that id exists
+    static bool ProcessRunning(uint32_t pid) noexcept;
+
     static char FormatBuffer[4096];
     inline static const char* Format(const char* fmt, ...) noexcept
     {
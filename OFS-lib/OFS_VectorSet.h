@@ -1,6 +1,7 @@
 #pragma once
 
 #include <algorithm>
+#include <vector>
 
 template<typename T>
 struct DefaultComparison {
@@ -10,6 +11,23 @@ struct DefaultComparison {
     }
 };
 
+// Merges two sorted ranges into out in a single pass.
+// Values comparing equal to an already merged value are skipped,
+// so on ties the value from the first range wins just like in emplace.
+template<typename Comparison, typename OutVector, typename ItA, typename ItB>
+inline void merge_unique(ItA firstA, ItA lastA, ItB firstB, ItB lastB, OutVector& out) noexcept
+{
+    Comparison comp;
+    while (firstA != lastA || firstB != lastB) {
+        auto next = (firstB == lastB || (firstA != lastA && !comp(*firstB, *firstA)))
+            ? *firstA++
+            : *firstB++;
+        if (out.empty() || comp(out.back(), next)) {
+            out.emplace_back(std::move(next));
+        }
+    }
+}
+
 template<typename T, typename Comparison = DefaultComparison<T>, typename Allocator = std::allocator<T>>
 class vector_set: public std::vector<T, Allocator> {
 private:
@@ -43,6 +61,30 @@ public:
         this->emplace_back(a);
     }
 
+    // inserts a sorted range with a single linear merge instead of one insert per value
+    template<typename InputIt>
+    inline void merge(InputIt first, InputIt last) noexcept
+    {
+        std::vector<T, Allocator> merged;
+        merged.reserve(this->size() + std::distance(first, last));
+        merge_unique<Comparison>(this->cbegin(), this->cend(), first, last, merged);
+        this->swap(merged);
+    }
+
+    // calls fn(T* values, size_t count) for every contiguous range of values
+    // fn must not change the order of the values
+    template<typename Fn>
+    inline void for_each_span(Fn&& fn) noexcept
+    {
+        if (!this->empty()) fn(this->data(), this->size());
+    }
+
+    template<typename Fn>
+    inline void for_each_span(Fn&& fn) const noexcept
+    {
+        if (!this->empty()) fn(this->data(), this->size());
+    }
+
     inline auto find(const T& a) noexcept
     {
         auto it = lower_bound(a);
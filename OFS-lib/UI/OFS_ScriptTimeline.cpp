@@ -47,8 +47,26 @@ void ScriptTimeline::updateSelection(const OverlayDrawingCtx& ctx, bool clear) n
 	EV::Enqueue<FunscriptShouldSelectTimeEvent>(startTime, endTime, clear, ctx.ActiveScript());
 }
 
+void ScriptTimeline::FfmpegAudioSamplesDecoded(const WaveformSamplesDecodedEvent* ev) noexcept
+{
+	if (ev->videoPath != videoPath) return;
+	Wave.data.AppendSamples(ev->samples, ev->maxSample);
+	Wave.Invalidate();
+	ShowAudioWaveform = true;
+}
+
 void ScriptTimeline::FfmpegAudioProcessingFinished(const WaveformProcessingFinishedEvent* ev) noexcept
 {
+	// the samples of another video were replaced in videoLoaded
+	if (ev->videoPath != videoPath) return;
+	if (!ev->success) {
+		// a truncated waveform would end up in the cache for this video
+		LOGF_ERROR("Failed to generate waveform for \"%s\"", ev->videoPath.c_str());
+		ClearAudioWaveform();
+		return;
+	}
+	Wave.data.MarkComplete();
+	Wave.Invalidate();
 	ShowAudioWaveform = true;
 	// Update cache
 	auto& waveCache = WaveformState::StaticStateSlow();
@@ -65,6 +83,8 @@ void ScriptTimeline::Init()
 		OFS_SDL_Event::HandleEvent(EVENT_SYSTEM_BIND(this, &ScriptTimeline::mouseScroll)));
 	EV::Queue().appendListener(WaveformProcessingFinishedEvent::EventType,
 		WaveformProcessingFinishedEvent::HandleEvent(EVENT_SYSTEM_BIND(this, &ScriptTimeline::FfmpegAudioProcessingFinished)));
+	EV::Queue().appendListener(WaveformSamplesDecodedEvent::EventType,
+		WaveformSamplesDecodedEvent::HandleEvent(EVENT_SYSTEM_BIND(this, &ScriptTimeline::FfmpegAudioSamplesDecoded)));
 	EV::Queue().appendListener(VideoLoadedEvent::EventType,
 		VideoLoadedEvent::HandleEvent(EVENT_SYSTEM_BIND(this, &ScriptTimeline::videoLoaded)));
 
@@ -459,18 +479,16 @@ void ScriptTimeline::ShowScriptPositions(
 				ImGui::EndMenu();
 			}
 
+			struct WaveformJob {
+				ScriptTimeline* ctx;
+				// videoPath changes on the main thread when a video gets loaded
+				std::string videoPath;
+			};
 			auto updateAudioWaveformThread = [](void* userData) -> int {
-				auto& ctx = *((ScriptTimeline*)userData);
-				std::error_code ec;
+				std::unique_ptr<WaveformJob> job((WaveformJob*)userData);
 				auto ffmpegPath = Util::FfmpegPath();
-				auto outputPath = Util::Prefpath("tmp");
-				if (!Util::CreateDirectories(outputPath)) {
-					return 0;
-				}
-				
-				outputPath = (Util::PathFromString(outputPath) / "audio.flac").u8string();
-				bool succ = ctx.Wave.data.GenerateAndLoadFlac(ffmpegPath.u8string(), ctx.videoPath, outputPath);
-				EV::Enqueue<WaveformProcessingFinishedEvent>();
+				bool succ = job->ctx->Wave.data.GenerateFromVideo(ffmpegPath.u8string(), job->videoPath);
+				EV::Enqueue<WaveformProcessingFinishedEvent>(job->videoPath, succ);
 				return 0;
 			};
 			if (ImGui::BeginMenu(TR_ID("WAVEFORM", Tr::WAVEFORM))) {
@@ -500,7 +518,9 @@ void ScriptTimeline::ShowScriptPositions(
 						}
 						else 
 						{
-							auto handle = SDL_CreateThread(updateAudioWaveformThread, "OFS_GenWaveform", this);
+							// filled progressively by WaveformSamplesDecodedEvent
+							Wave.data.Clear();
+							auto handle = SDL_CreateThread(updateAudioWaveformThread, "OFS_GenWaveform", new WaveformJob{ this, videoPath });
 							SDL_DetachThread(handle);
 						}
 					}
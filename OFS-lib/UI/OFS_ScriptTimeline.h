@@ -32,6 +32,7 @@ private:
 	bool handleTimelineClicks(const OverlayDrawingCtx& ctx) noexcept;
 
 	void updateSelection(const OverlayDrawingCtx& ctx, bool clear) noexcept;
+	void FfmpegAudioSamplesDecoded(const WaveformSamplesDecodedEvent* ev) noexcept;
 	void FfmpegAudioProcessingFinished(const WaveformProcessingFinishedEvent* ev) noexcept;
 
 	std::string videoPath;
@@ -2,6 +2,8 @@
 #include "OFS_Event.h"
 #include "Funscript.h"
 #include <cstdint>
+#include <vector>
+#include <string>
 
 class FunscriptActionClickedEvent : public OFS_Event<FunscriptActionClickedEvent>
 {
@@ -52,6 +54,25 @@ class ShouldChangeActiveScriptEvent : public OFS_Event<ShouldChangeActiveScriptE
 class WaveformProcessingFinishedEvent : public OFS_Event<WaveformProcessingFinishedEvent>
 {
     public:
+    std::string videoPath;
+    // false if ffmpeg failed, the samples decoded until then are incomplete
+    bool success;
+
+    WaveformProcessingFinishedEvent(const std::string& videoPath, bool success) noexcept
+        : videoPath(videoPath), success(success) {}
+};
+
+// sent from the decoding thread with the lines decoded since the last event
+class WaveformSamplesDecodedEvent : public OFS_Event<WaveformSamplesDecodedEvent>
+{
+    public:
+    // another video may have been loaded while decoding
+    std::string videoPath;
+    std::vector<float> samples;
+    float maxSample;
+
+    WaveformSamplesDecodedEvent(const std::string& videoPath, std::vector<float>&& samples, float maxSample) noexcept
+        : videoPath(videoPath), samples(std::move(samples)), maxSample(maxSample) {}
 };
 
 class FunscriptShouldSelectTimeEvent : public OFS_Event<FunscriptShouldSelectTimeEvent>
@@ -41,6 +41,11 @@ public:
 		Heatmap->Update(totalDuration, actions);
 	}
 
+	inline void UpdateHeatmapRange(float totalDuration, const FunscriptArray& actions, float fromTime, float toTime) noexcept
+	{
+		Heatmap->UpdateRange(totalDuration, actions, fromTime, toTime);
+	}
+
 	void DrawTimeline() noexcept;
 	void DrawControls() noexcept;
 
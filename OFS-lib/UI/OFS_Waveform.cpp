@@ -3,74 +3,206 @@
 #include "OFS_Profiling.h"
 #include "OFS_GL.h"
 #include "OFS_ScriptTimeline.h"
+#include "OFS_EventSystem.h"
+#include "OFS_Simd.h"
+
+#include <array>
+#include <cstring>
 
 #define DR_FLAC_IMPLEMENTATION
 #include "dr_flac.h"
 
 #include "subprocess.h"
 
+// sum of abs(sample) of SamplesPerLine samples, the sum is exact
+inline static int32_t sumAbsLine(const int16_t* pcm) noexcept
+{
+	constexpr int SamplesPerLine = OFS_Waveform::SamplesPerLine;
+	int32_t sum = 0;
+	int i = 0;
+#if OFS_SSE2
+	__m128i zero = _mm_setzero_si128();
+	__m128i acc = zero;
+	for (; i + 8 <= SamplesPerLine; i += 8) {
+		__m128i v = _mm_loadu_si128((const __m128i*)(pcm + i));
+		__m128i sign = _mm_srai_epi16(v, 15);
+		// -32768 wraps to 0x8000 which is 32768 when read as unsigned
+		__m128i abs = _mm_sub_epi16(_mm_xor_si128(v, sign), sign);
+		acc = _mm_add_epi32(acc, _mm_unpacklo_epi16(abs, zero));
+		acc = _mm_add_epi32(acc, _mm_unpackhi_epi16(abs, zero));
+	}
+	acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(1, 0, 3, 2)));
+	acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(2, 3, 0, 1)));
+	sum = _mm_cvtsi128_si32(acc);
+#endif
+	for (; i < SamplesPerLine; i += 1) {
+		sum += std::abs((int32_t)pcm[i]);
+	}
+	return sum;
+}
+
+void WaveformLineBuilder::addLine(int32_t sum, std::vector<float>& outLines) noexcept
+{
+	float line = sum / (32768.f * OFS_Waveform::SamplesPerLine);
+	MaxLine = Util::Max(MaxLine, line);
+	outLines.emplace_back(line);
+}
+
+void WaveformLineBuilder::Add(const int16_t* pcm, size_t count, std::vector<float>& outLines) noexcept
+{
+	OFS_PROFILE(__FUNCTION__);
+	constexpr int SamplesPerLine = OFS_Waveform::SamplesPerLine;
+	if (carryCount > 0) {
+		size_t fill = Util::Min<size_t>(SamplesPerLine - carryCount, count);
+		std::memcpy(carry.data() + carryCount, pcm, fill * sizeof(int16_t));
+		carryCount += fill;
+		pcm += fill;
+		count -= fill;
+		if (carryCount < SamplesPerLine) return;
+		addLine(sumAbsLine(carry.data()), outLines);
+		carryCount = 0;
+	}
+
+	outLines.reserve(outLines.size() + count / SamplesPerLine);
+	for (; count >= SamplesPerLine; pcm += SamplesPerLine, count -= SamplesPerLine) {
+		addLine(sumAbsLine(pcm), outLines);
+	}
+
+	std::memcpy(carry.data(), pcm, count * sizeof(int16_t));
+	carryCount = count;
+}
+
+void WaveformLineBuilder::Finish(std::vector<float>& outLines) noexcept
+{
+	if (carryCount == 0) return;
+	std::fill(carry.begin() + carryCount, carry.end(), 0);
+	addLine(sumAbsLine(carry.data()), outLines);
+	carryCount = 0;
+}
+
 bool OFS_Waveform::LoadFlac(const std::string& output) noexcept
 {
+	OFS_PROFILE(__FUNCTION__);
 	drflac* flac = drflac_open_file(output.c_str(), NULL);
 	if (!flac) return false;
 
 	std::vector<drflac_int16> ChunkSamples; ChunkSamples.resize(48000);
-	constexpr int SamplesPerLine = 300; 
-
-	float minSample = 0.f;
-	float maxSample = 0.f;
+	WaveformLineBuilder lineBuilder;
 
 	uint32_t sampleCount = 0;
-	float avgSample = 0.f;
 	Clear();
-	samples.reserve(flac->totalPCMFrameCount / SamplesPerLine);
+	samples.reserve(flac->totalPCMFrameCount / SamplesPerLine + 1);
 	while ((sampleCount = drflac_read_pcm_frames_s16(flac, ChunkSamples.size(), ChunkSamples.data())) > 0) {
-		for (int sampleIdx = 0; sampleIdx < sampleCount; sampleIdx += SamplesPerLine) {
-			int samplesInThisLine = std::min(SamplesPerLine, (int)sampleCount - sampleIdx);
-			for (int i = 0; i < samplesInThisLine; i += 1) {
-				drflac_int16 sample = ChunkSamples[sampleIdx + i];
-				sample = std::abs(sample);
-				auto floatSample = sample / 32768.f;
-				avgSample += floatSample;
-			}
-			avgSample /= (float)SamplesPerLine;
-			minSample = Util::Min(minSample, avgSample);
-			maxSample = Util::Max(maxSample, avgSample);
-			samples.emplace_back(avgSample);
-			avgSample = 0.f;
-		}
+		lineBuilder.Add(ChunkSamples.data(), sampleCount, samples);
 	}
+	lineBuilder.Finish(samples);
 	drflac_close(flac);
 	samples.shrink_to_fit();
 
-	if(std::abs(minSample) > std::abs(maxSample)) {
-		maxSample = std::abs(minSample);
+	float maxSample = lineBuilder.MaxLine;
+	if (maxSample > 0.f) {
+		for(auto& sample : samples) {
+			sample /= maxSample;
+		}
+	}
+	buildLevels();
+
+	return true;
+}
+
+void OFS_Waveform::buildLevels(size_t firstSample) noexcept
+{
+	OFS_PROFILE(__FUNCTION__);
+	if (samples.size() < 2) {
+		levels.clear();
+		return;
 	}
-	else {
-		minSample = -maxSample;
+
+	// every entry at or after first depends on changed values
+	size_t first = firstSample / 2;
+	size_t sourceSize = samples.size();
+	for (size_t level = 0; sourceSize > 1; level += 1) {
+		if (level == levels.size()) levels.emplace_back();
+		auto& values = levels[level];
+		values.resize((sourceSize + 1) / 2);
+		for (size_t i = first * 2; i < sourceSize; i += 2) {
+			if (level == 0) {
+				float s = std::abs(samples[i]);
+				values[i / 2] = i + 1 < sourceSize ? Util::Max(s, std::abs(samples[i + 1])) : s;
+			}
+			else {
+				auto& prev = levels[level - 1];
+				values[i / 2] = i + 1 < sourceSize ? Util::Max(prev[i], prev[i + 1]) : prev[i];
+			}
+		}
+		sourceSize = values.size();
+		first /= 2;
+		if (sourceSize == 1) levels.resize(level + 1);
 	}
+}
 
-	for(auto& sample : samples) {
-		sample = Util::MapRange(sample, minSample, maxSample, -1.f, 1.f);
+void OFS_Waveform::AppendSamples(const std::vector<float>& lines, float maxSample) noexcept
+{
+	OFS_PROFILE(__FUNCTION__);
+	size_t firstSample = samples.size();
+	if (maxSample > normalizedMax) {
+		// everything decoded so far gets scaled to the new maximum
+		float scale = normalizedMax / maxSample;
+		for (auto& sample : samples) {
+			sample *= scale;
+		}
+		normalizedMax = maxSample;
+		firstSample = 0;
 	}
 
-	return true;
+	samples.reserve(samples.size() + lines.size());
+	for (auto line : lines) {
+		samples.emplace_back(normalizedMax > 0.f ? line / normalizedMax : 0.f);
+	}
+	complete = false;
+	buildLevels(firstSample);
 }
 
-bool OFS_Waveform::GenerateAndLoadFlac(const std::string& ffmpegPath, const std::string& videoPath, const std::string& output) noexcept
+float OFS_Waveform::MaxInRange(int32_t begin, int32_t end) const noexcept
 {
+	begin = Util::Max(begin, 0);
+	end = Util::Min(end, (int32_t)samples.size());
+	if (begin >= end) return 0.f;
+
+	// walk up the pyramid, only the unaligned ends of each level have to be looked at
+	uint32_t lo = begin;
+	uint32_t hi = end;
+	float maxSample = 0.f;
+	if (lo & 1) maxSample = Util::Max(maxSample, std::abs(samples[lo++]));
+	if (hi & 1) maxSample = Util::Max(maxSample, std::abs(samples[--hi]));
+	lo >>= 1; hi >>= 1;
+	for (size_t level = 0; lo < hi && level < levels.size(); level += 1) {
+		auto& values = levels[level];
+		if (lo & 1) maxSample = Util::Max(maxSample, values[lo++]);
+		if (hi & 1) maxSample = Util::Max(maxSample, values[--hi]);
+		lo >>= 1; hi >>= 1;
+	}
+	return maxSample;
+}
+
+bool OFS_Waveform::GenerateFromVideo(const std::string& ffmpegPath, const std::string& videoPath) noexcept
+{
+	OFS_PROFILE(__FUNCTION__);
 	generating = true;
 
-	std::array<const char*, 11> args =
+	// raw mono pcm on stdout, nothing is written to disk
+	std::array<const char*, 16> args =
 	{
 		ffmpegPath.c_str(),
-		"-y",
 		"-loglevel",
 		"quiet",
 		"-i", videoPath.c_str(),
 		"-vn",
 		"-ac", "1",
-		output.c_str(),
+		"-ar", "48000",
+		"-f", "s16le",
+		"-acodec", "pcm_s16le",
+		"-",
 		nullptr
 	};
 	struct subprocess_s proc;
@@ -79,29 +211,42 @@ bool OFS_Waveform::GenerateAndLoadFlac(const std::string& ffmpegPath, const std:
 		return false; 
 	}
 
-	if(proc.stdout_file) 
-	{
-		fclose(proc.stdout_file);
-		proc.stdout_file = nullptr;
-	}
-	
 	if(proc.stderr_file) 
 	{
 		fclose(proc.stderr_file);
 		proc.stderr_file = nullptr;
 	}
 
-	int return_code;
-	subprocess_join(&proc, &return_code);
-	subprocess_destroy(&proc);
+	std::vector<int16_t> chunk; chunk.resize(SampleRate);
+	std::vector<float> lines;
+	WaveformLineBuilder lineBuilder;
+	uint32_t lastPublish = SDL_GetTicks();
 
-	if (!LoadFlac(output)) {
-		generating = false;
-		return false;
+	auto publish = [&lines, &lineBuilder, &videoPath]() noexcept {
+		if (lines.empty()) return;
+		EV::Enqueue<WaveformSamplesDecodedEvent>(videoPath, std::move(lines), lineBuilder.MaxLine);
+		lines = std::vector<float>();
+	};
+
+	size_t sampleCount;
+	while ((sampleCount = fread(chunk.data(), sizeof(int16_t), chunk.size(), proc.stdout_file)) > 0) {
+		lineBuilder.Add(chunk.data(), sampleCount, lines);
+
+		// a few updates per second are enough to watch the waveform fill up
+		if (SDL_GetTicks() - lastPublish >= 250) {
+			publish();
+			lastPublish = SDL_GetTicks();
+		}
 	}
+	lineBuilder.Finish(lines);
+	publish();
+
+	int returnCode;
+	subprocess_join(&proc, &returnCode);
+	subprocess_destroy(&proc);
 
 	generating = false;
-	return true;
+	return returnCode == 0;
 }
 
 void OFS_WaveformLOD::Init() noexcept
@@ -122,7 +267,10 @@ void OFS_WaveformLOD::Update(const OverlayDrawingCtx& ctx) noexcept
 	const float relDuration = ctx.visibleTime / ctx.totalDuration;
 	
 	const auto& samples = data.Samples();
-	const float totalSampleCount = samples.size();
+	// while decoding the samples only cover the start of the video
+	const float totalSampleCount = data.IsComplete()
+		? samples.size()
+		: Util::Max((float)samples.size(), ctx.totalDuration * OFS_Waveform::LinesPerSecond);
 
 	float startIndexF = relStart * totalSampleCount;
 	float endIndexF = (relStart* totalSampleCount) + (totalSampleCount * relDuration);
@@ -144,17 +292,8 @@ void OFS_WaveformLOD::Update(const OverlayDrawingCtx& ctx) noexcept
 			lineBuf.resize(lineBuf.size() - scrollBy);
 			
 			int addedCount = 0;
-			float maxSample;
 			for(int32_t i = endIndexF - (everyNth*scrollBy); i <= endIndexF; i += everyNth) {
-				maxSample = 0.f;
-				for(int32_t j=0; j < everyNth; j += 1) {
-					int32_t currentIndex = i + j;
-					if(currentIndex >= 0 && currentIndex < totalSampleCount) {
-						float s = std::abs(samples[currentIndex]);
-						maxSample = Util::Max(maxSample, s);
-					}
-				}
-				lineBuf.emplace_back(maxSample);
+				lineBuf.emplace_back(data.MaxInRange(i, i + everyNth));
 				addedCount += 1; 
 				if(addedCount == scrollBy) break;
 			}
@@ -162,17 +301,8 @@ void OFS_WaveformLOD::Update(const OverlayDrawingCtx& ctx) noexcept
 		} else if(scrollBy != 0) {
 			OFS_PROFILE("WaveformUpdate");
 			lineBuf.clear();
-			float maxSample;
 			for(int32_t i = startIndexF; i <= endIndexF; i += everyNth) {
-				maxSample = 0.f;
-				for(int32_t j=0; j < everyNth; j += 1) {
-					int32_t currentIndex = i + j;
-					if(currentIndex >= 0 && currentIndex < totalSampleCount) {
-						float s = std::abs(samples[currentIndex]);
-						maxSample = Util::Max(maxSample, s);
-					}
-				}
-				lineBuf.emplace_back(maxSample);
+				lineBuf.emplace_back(data.MaxInRange(i, i + everyNth));
 			}
 		}
 
@@ -3,6 +3,8 @@
 #include <vector>
 #include <string>
 #include <memory>
+#include <array>
+#include <cstdint>
 
 #include "OFS_BinarySerialization.h"
 #include "OFS_Shader.h"
@@ -14,22 +16,51 @@
 class OFS_Waveform
 {
 	bool generating = false;
+	// false while samples are still being decoded
+	bool complete = true;
+	// the maximum the samples are currently normalized to
+	float normalizedMax = 0.f;
 	std::vector<float> samples;
+	// max(abs(sample)) pyramid, every level halves the previous one
+	// the first level is made from the samples, the last one has a single entry
+	std::vector<std::vector<float>> levels;
+
+	// rebuilds the levels covering samples from firstSample onwards
+	void buildLevels(size_t firstSample = 0) noexcept;
 public:
+	static constexpr int SampleRate = 48000;
+	static constexpr int SamplesPerLine = 300;
+	static constexpr float LinesPerSecond = (float)SampleRate / SamplesPerLine;
 
 	inline bool BusyGenerating() noexcept { return generating; }
-	bool GenerateAndLoadFlac(const std::string& ffmpegPath, const std::string& videoPath, const std::string& output) noexcept;
+	// decodes the audio piped from ffmpeg on the calling thread
+	// the lines are sent to the main thread as WaveformSamplesDecodedEvent and added with AppendSamples
+	bool GenerateFromVideo(const std::string& ffmpegPath, const std::string& videoPath) noexcept;
 	bool LoadFlac(const std::string& path) noexcept;
 
 	inline void Clear() noexcept {
 		samples.clear();
+		levels.clear();
+		normalizedMax = 0.f;
+		complete = true;
 	}
 
 	inline void SetSamples(std::vector<float>&& samples) noexcept
 	{
 		this->samples = std::move(samples);
+		complete = true;
+		buildLevels();
 	}
 
+	// adds decoded lines which aren't normalized yet, maxSample is the maximum of all lines decoded so far
+	void AppendSamples(const std::vector<float>& lines, float maxSample) noexcept;
+	inline void MarkComplete() noexcept { complete = true; }
+	inline bool IsComplete() const noexcept { return complete; }
+
+	// max(abs(sample)) of the samples in [begin, end), indices outside of the samples are ignored
+	// O(log(end - begin)) using the pyramid
+	float MaxInRange(int32_t begin, int32_t end) const noexcept;
+
 	inline const std::vector<float>& Samples() const noexcept { return samples; }
 
 	inline size_t SampleCount() const noexcept {
@@ -37,6 +68,22 @@ public:
 	}
 };
 
+// averages abs(sample) over SamplesPerLine samples
+// samples which don't fill a line are carried over to the next Add
+class WaveformLineBuilder
+{
+	std::array<int16_t, OFS_Waveform::SamplesPerLine> carry;
+	int carryCount = 0;
+
+	void addLine(int32_t sum, std::vector<float>& outLines) noexcept;
+public:
+	float MaxLine = 0.f;
+
+	void Add(const int16_t* pcm, size_t count, std::vector<float>& outLines) noexcept;
+	// the last line is averaged like a full line
+	void Finish(std::vector<float>& outLines) noexcept;
+};
+
 struct OFS_WaveformLOD
 {
 	std::vector<float> WaveformLineBuffer;
@@ -53,5 +100,7 @@ struct OFS_WaveformLOD
 
 	void Init() noexcept;
 	void Update(const class OverlayDrawingCtx& ctx) noexcept;
+	// forces the next Update to recompute the whole line buffer
+	inline void Invalidate() noexcept { lastMultiple = -1; lastVisibleDuration = 0.f; }
 	void Upload() noexcept;
 };
\ No newline at end of file
@@ -7,6 +7,7 @@
 #include "state/states/BaseOverlayState.h"
 
 #include <cmath>
+#include <algorithm>
 
 std::vector<BaseOverlay::ColoredLine> BaseOverlay::ColoredLines;
 
@@ -89,11 +90,22 @@ ImVec2 BaseOverlay::GetPointForAction(const OverlayDrawingCtx& ctx, FunscriptAct
 
 void BaseOverlay::drawActionLinesSpline(const OverlayDrawingCtx& ctx, const BaseOverlayState& state) noexcept
 {
-    auto drawSpline = [](const OverlayDrawingCtx& ctx, FunscriptAction startAction, FunscriptAction endAction, uint32_t color, float width, bool background = true) noexcept
+    constexpr float SamplesPerTwothousandPixels = 150.f;
+    const float MaximumSamples = SamplesPerTwothousandPixels * (ctx.canvasSize.x / 2000.f);
+    const float timeStep = ctx.visibleTime / MaximumSamples;
+    if (!(timeStep > 0.f)) return;
+
+    // the whole visible span is sampled in one call
+    // the first sample is aligned to timeStep so the samples don't move while scrolling
+    static std::vector<float> splineSamples;
+    const float firstSampleTime = std::floor(ctx.offsetTime / timeStep) * timeStep;
+    const size_t sampleCount = (size_t)(MaximumSamples) + 3;
+    const float lastSampleTime = firstSampleTime + (float)(sampleCount - 1) * timeStep;
+    splineSamples.resize(sampleCount);
+    ctx.DrawingScript()->SplineRange(firstSampleTime, timeStep, sampleCount, splineSamples.data());
+
+    auto drawSpline = [firstSampleTime, lastSampleTime, timeStep, sampleCount](const OverlayDrawingCtx& ctx, FunscriptAction startAction, FunscriptAction endAction, uint32_t color, float width, bool background = true) noexcept
     {
-        constexpr float SamplesPerTwothousandPixels = 150.f;
-        const float MaximumSamples = SamplesPerTwothousandPixels * (ctx.canvasSize.x / 2000.f);
-
         auto getPointForTimePos = [](const OverlayDrawingCtx& ctx, float time, float pos) noexcept {
             float relative_x = (float)(time - ctx.offsetTime) / ctx.visibleTime;
             float x = (ctx.canvasSize.x) * relative_x;
@@ -102,46 +114,16 @@ void BaseOverlay::drawActionLinesSpline(const OverlayDrawingCtx& ctx, const Base
             y += ctx.canvasPos.y;
             return ImVec2(x, y);
         };
-        auto putPoint = [getPointForTimePos](auto& ctx, float time) noexcept {
-            float pos = Util::Clamp<float>(ctx.DrawingScript()->Spline(time) * 100.f, 0.f, 100.f);
-            ctx.drawList->PathLineTo(getPointForTimePos(ctx, time, pos));
-        };
+        auto sampleTime = [firstSampleTime, timeStep](size_t i) noexcept { return firstSampleTime + (float)i * timeStep; };
 
-        ctx.drawList->PathClear();
-        float visibleDuration;
-        float currentTime;
-        float endTime;
-        if (startAction.atS >= ctx.offsetTime && endAction.atS <= (ctx.offsetTime + ctx.visibleTime)) {
-            currentTime = startAction.atS;
-            endTime = endAction.atS;
-            visibleDuration = endTime - currentTime;
-        }
-        else if (startAction.atS < ctx.offsetTime && endAction.atS > (ctx.offsetTime + ctx.visibleTime)) {
-            // clip at the invisible area in both direction
-            currentTime = ctx.offsetTime;
-            endTime = (ctx.offsetTime + ctx.visibleTime);
-            visibleDuration = ctx.visibleTime;
-        }
-        else if (startAction.atS < ctx.offsetTime) {
-            // clip invisible area on the left
-            currentTime = ctx.offsetTime;
-            endTime = endAction.atS;
-            visibleDuration = endAction.atS - ctx.offsetTime;
-        }
-        else if (endAction.atS > (ctx.offsetTime + ctx.visibleTime)) {
-            // clip invisble area on the right
-            currentTime = startAction.atS;
-            endTime = (ctx.offsetTime + ctx.visibleTime) + 0.001f;
-            visibleDuration = endTime - startAction.atS;
-        }
+        // clip at the invisible area
+        const float startTime = std::max(startAction.atS, firstSampleTime);
+        const float endTime = std::min(endAction.atS, lastSampleTime);
 
-        // detail gets dynamically reduced by increasing the timeStep,
-        // at which is being sampled from the spline
-        const float ratio = visibleDuration / ctx.visibleTime;
-        const float SampleCount = MaximumSamples * ratio;
+        // detail gets dynamically reduced by only using the samples between the two actions
+        const float SampleCount = (endTime - startTime) / timeStep;
 
-        const float timeStep = visibleDuration / SampleCount;
-        
+        ctx.drawList->PathClear();
         if (SampleCount < 3.f) {
             auto p1 = BaseOverlay::GetPointForAction(ctx, startAction);
             auto p2 = BaseOverlay::GetPointForAction(ctx, endAction);
@@ -153,13 +135,18 @@ void BaseOverlay::drawActionLinesSpline(const OverlayDrawingCtx& ctx, const Base
             ColoredLines.emplace_back(std::move(BaseOverlay::ColoredLine{ p1, p2, color }));
         }
         else {
-            putPoint(ctx, currentTime);
-            currentTime += timeStep;
-            while (currentTime < endTime) {
-                putPoint(ctx, currentTime);
-                currentTime += timeStep;
+            if (startAction.atS >= firstSampleTime) {
+                ctx.drawList->PathLineTo(BaseOverlay::GetPointForAction(ctx, startAction));
+            }
+            size_t i = (size_t)std::max(0.f, (startTime - firstSampleTime) / timeStep);
+            while (i < sampleCount && sampleTime(i) <= startAction.atS) ++i;
+            for (; i < sampleCount && sampleTime(i) < endAction.atS; ++i) {
+                float pos = Util::Clamp<float>(splineSamples[i] * 100.f, 0.f, 100.f);
+                ctx.drawList->PathLineTo(getPointForTimePos(ctx, sampleTime(i), pos));
+            }
+            if (endAction.atS <= lastSampleTime) {
+                ctx.drawList->PathLineTo(BaseOverlay::GetPointForAction(ctx, endAction));
             }
-            putPoint(ctx, endAction.atS);
             auto tmpSize = ctx.drawList->_Path.Size;
             ctx.drawList->PathStroke(IM_COL32_BLACK, false, 7.f);
             ctx.drawList->_Path.Size = tmpSize;
@@ -5,6 +5,24 @@
 
 #include "OFS_VideoplayerEvents.h"
 
+#include "SDL_timer.h"
+
+// The playback position at a point in time, see OFS_Videoplayer::Clock
+struct OFS_PlayerClock
+{
+    double time = 0.0; // media time in seconds at counter
+    uint64_t counter = 0; // SDL_GetPerformanceCounter
+    float speed = 1.f;
+    bool paused = true;
+
+    inline double TimeAt(uint64_t now) const noexcept
+    {
+        if(paused) return time;
+        double elapsed = (double)(int64_t)(now - counter) / (double)SDL_GetPerformanceFrequency();
+        return time + elapsed * speed;
+    }
+};
+
 class OFS_Videoplayer
 {
     private:
@@ -70,6 +88,9 @@ class OFS_Videoplayer
     float CurrentPercentPosition() const noexcept;
     // Also uses the logical position
     double CurrentTime() const noexcept;
+    // Same smoothing as CurrentTime with the performance counter instead of SDL_GetTicks64
+    // The time can be extrapolated until the next update without calling into the player
+    OFS_PlayerClock Clock() const noexcept;
 
     // The "actual" position reported by the player
     double CurrentPlayerPosition() const noexcept; 
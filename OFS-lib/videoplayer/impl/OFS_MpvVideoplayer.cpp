@@ -64,6 +64,8 @@ struct MpvPlayerContext
     float* logicalPosition = nullptr;
 
     uint64_t smoothTimer = 0;
+    // SDL_GetPerformanceCounter taken together with smoothTimer
+    uint64_t smoothCounter = 0;
     VideoplayerType playerType;
 };
 
@@ -321,6 +323,7 @@ inline static void ProcessEvents(MpvPlayerContext* ctx) noexcept
                         auto newPercentPos = (*(double*)prop->data) / 100.0;
                         ctx->data.percentPos = newPercentPos;
                         ctx->smoothTimer = SDL_GetTicks64();
+                        ctx->smoothCounter = SDL_GetPerformanceCounter();
                         if(!ctx->data.paused) {
                             *ctx->logicalPosition = newPercentPos;
                         }
@@ -340,6 +343,7 @@ inline static void ProcessEvents(MpvPlayerContext* ctx) noexcept
                             *ctx->logicalPosition += positionOffset;
                         }
                         ctx->smoothTimer = SDL_GetTicks64();
+                        ctx->smoothCounter = SDL_GetPerformanceCounter();
                         ctx->data.paused = paused;
                         notifyPaused(ctx);
                         break;
@@ -606,6 +610,27 @@ double OFS_Videoplayer::CurrentTime() const noexcept
     }
 }
 
+OFS_PlayerClock OFS_Videoplayer::Clock() const noexcept
+{
+    OFS_PlayerClock clock;
+    clock.speed = CTX->data.currentSpeed;
+    clock.paused = CTX->data.paused;
+    if(CTX->data.paused)
+    {
+        clock.time = logicalPosition * CTX->data.duration;
+        clock.counter = SDL_GetPerformanceCounter();
+    }
+    else 
+    {
+        // logicalPosition is only a float, which is off by a few hundred microseconds in long videos
+        // use mpv's position unless there was a seek since the last update
+        double position = logicalPosition == (float)CTX->data.percentPos ? CTX->data.percentPos : logicalPosition;
+        clock.time = position * CTX->data.duration;
+        clock.counter = CTX->smoothCounter;
+    }
+    return clock;
+}
+
 double OFS_Videoplayer::CurrentPlayerPosition() const noexcept
 {
     return CTX->data.percentPos;
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+
+namespace OFS_Bench
+{
+	// the fastest of iterations runs in seconds, the first run also warms up caches
+	template<typename Fn>
+	inline double Best(int iterations, Fn&& fn) noexcept
+	{
+		double best = 0.0;
+		for (int i = 0; i < iterations; i += 1) {
+			auto start = std::chrono::steady_clock::now();
+			fn();
+			std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+			if (i == 0 || elapsed.count() < best) best = elapsed.count();
+		}
+		return best;
+	}
+
+	// deterministic input so runs can be compared
+	struct Random
+	{
+		uint32_t state = 0x12345678;
+		inline uint32_t Next() noexcept
+		{
+			// xorshift32
+			state ^= state << 13;
+			state ^= state >> 17;
+			state ^= state << 5;
+			return state;
+		}
+		inline float NextFloat() noexcept { return (Next() >> 8) / 16777216.f; }
+	};
+
+	// first command line argument as a positive number or fallback
+	inline long Arg(int argc, char* argv[], long fallback) noexcept
+	{
+		if (argc < 2) return fallback;
+		long value = std::strtol(argv[1], nullptr, 10);
+		return value > 0 ? value : fallback;
+	}
+
+	// keeps the optimizer from dropping a result
+	template<typename T>
+	inline void Keep(const T& value) noexcept
+	{
+		static volatile T sink;
+		sink = value;
+	}
+}
@@ -0,0 +1,97 @@
+// Compares the two FunscriptArray backends (vector_set and chunked_set, see OFS_CHUNKED_ACTIONS)
+// on a long script: inserting and removing single actions, lookups, positional access and iteration.
+// usage: bench_actions [thousands of actions, default 1000]
+#include "OFS_Bench.h"
+#include "FunscriptAction.h"
+
+#include <cstdio>
+#include <vector>
+
+using VectorActions = vector_set<FunscriptAction, ActionLess>;
+using ChunkedActions = chunked_set<FunscriptAction, ActionLess>;
+
+// one action every 50ms
+constexpr float ActionSpacing = 0.05f;
+constexpr int EditCount = 2000;
+constexpr int LookupCount = 1000000;
+
+struct Timings
+{
+	double edit = 0.0;
+	double lookup = 0.0;
+	double index = 0.0;
+	double iterate = 0.0;
+};
+
+template<typename Actions>
+static Timings benchActions(size_t actionCount) noexcept
+{
+	Actions actions;
+	actions.reserve(actionCount);
+	for (size_t i = 0; i < actionCount; i += 1) {
+		actions.emplace_back_unsorted(FunscriptAction(i * ActionSpacing, (int32_t)(i % 101)));
+	}
+
+	// the same random input for both containers
+	OFS_Bench::Random random;
+	std::vector<FunscriptAction> edits;
+	for (int i = 0; i < EditCount; i += 1) {
+		// halfway between two existing actions so every insert succeeds
+		size_t idx = random.Next() % actionCount;
+		edits.emplace_back((idx + 0.5f) * ActionSpacing, (int32_t)(idx % 101));
+	}
+	std::vector<FunscriptAction> lookups;
+	std::vector<size_t> indices;
+	for (int i = 0; i < LookupCount; i += 1) {
+		lookups.emplace_back(random.NextFloat() * actionCount * ActionSpacing, 0);
+		indices.emplace_back(random.Next() % actionCount);
+	}
+
+	Timings timings;
+	// insert and remove again like adding and undoing an action, leaves the script unchanged
+	timings.edit = OFS_Bench::Best(3, [&]() noexcept {
+		for (auto action : edits) actions.emplace(action);
+		for (auto action : edits) {
+			auto it = actions.find(action);
+			if (it != actions.end()) actions.erase(it);
+		}
+	});
+	timings.lookup = OFS_Bench::Best(3, [&]() noexcept {
+		int32_t sum = 0;
+		for (auto action : lookups) {
+			auto it = actions.lower_bound(action);
+			if (it != actions.end()) sum += it->pos;
+		}
+		OFS_Bench::Keep(sum);
+	});
+	timings.index = OFS_Bench::Best(3, [&]() noexcept {
+		int32_t sum = 0;
+		for (auto idx : indices) sum += actions[idx].pos;
+		OFS_Bench::Keep(sum);
+	});
+	timings.iterate = OFS_Bench::Best(3, [&]() noexcept {
+		int32_t sum = 0;
+		for (auto& action : actions) sum += action.pos;
+		OFS_Bench::Keep(sum);
+	});
+	return timings;
+}
+
+int main(int argc, char* argv[])
+{
+	size_t actionCount = (size_t)OFS_Bench::Arg(argc, argv, 1000) * 1000;
+	printf("%zu actions\n", actionCount);
+
+	auto vector = benchActions<VectorActions>(actionCount);
+	auto chunked = benchActions<ChunkedActions>(actionCount);
+
+	auto print = [](const char* name, double vectorSeconds, double chunkedSeconds, size_t ops) noexcept {
+		printf("%-24s vector_set %9.1f ns/op   chunked_set %9.1f ns/op   %.2fx\n", name,
+			vectorSeconds / ops * 1e9, chunkedSeconds / ops * 1e9, vectorSeconds / chunkedSeconds);
+	};
+	print("insert + erase", vector.edit, chunked.edit, EditCount * 2);
+	print("lower_bound", vector.lookup, chunked.lookup, LookupCount);
+	print("operator[]", vector.index, chunked.index, LookupCount);
+	print("iterate", vector.iterate, chunked.iterate, actionCount);
+	return 0;
+}
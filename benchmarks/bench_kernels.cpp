@@ -0,0 +1,91 @@
+// Compares FunscriptActionKernels to the plain per action loops they replaced
+// on a long script, plus SampleLinear against one lower_bound per sample like Funscript::GetPositionAtTime.
+// usage: bench_kernels [thousands of actions, default 1000]
+#include "OFS_Bench.h"
+#include "FunscriptActionKernels.h"
+#include "OFS_Simd.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <algorithm>
+
+// one action every 50ms
+constexpr float ActionSpacing = 0.05f;
+
+static void scalarOffsetTime(std::vector<FunscriptAction>& actions, float offset) noexcept
+{
+	for (auto& action : actions) action.atS += offset;
+}
+
+static void scalarOffsetPosition(std::vector<FunscriptAction>& actions, int32_t offset) noexcept
+{
+	for (auto& action : actions) action.pos = std::clamp<int32_t>(action.pos + offset, 0, 100);
+}
+
+static void scalarInvertPosition(std::vector<FunscriptAction>& actions) noexcept
+{
+	for (auto& action : actions) action.pos = std::abs(action.pos - 100);
+}
+
+static void scalarSampleLinear(const std::vector<FunscriptAction>& actions, float startTime, float stepTime, float* outPositions, size_t count) noexcept
+{
+	for (size_t i = 0; i < count; i += 1) {
+		float time = startTime + i * stepTime;
+		auto it = std::lower_bound(actions.begin(), actions.end(), FunscriptAction(time, 0), ActionLess{});
+		if (it == actions.end() || it == actions.begin()) {
+			outPositions[i] = actions.back().pos;
+			continue;
+		}
+		auto& action = *(it - 1);
+		float progress = (time - action.atS) / (it->atS - action.atS);
+		outPositions[i] = action.pos + progress * (float)(it->pos - action.pos);
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	size_t actionCount = (size_t)OFS_Bench::Arg(argc, argv, 1000) * 1000;
+
+	std::vector<FunscriptAction> actions;
+	FunscriptArray array;
+	OFS_Bench::Random random;
+	for (size_t i = 0; i < actionCount; i += 1) {
+		FunscriptAction action(i * ActionSpacing, (int32_t)(random.Next() % 101));
+		actions.emplace_back(action);
+		array.emplace_back_unsorted(action);
+	}
+
+	auto run = [&](const char* name, auto&& scalar, auto&& kernel) noexcept {
+		// the transforms run in place, the values don't change the speed
+		double scalarSeconds = OFS_Bench::Best(10, scalar);
+		double kernelSeconds = OFS_Bench::Best(10, kernel);
+		printf("%-16s loop %8.1f Mactions/s   kernel %8.1f Mactions/s   %.2fx\n", name,
+			actionCount / scalarSeconds / 1e6, actionCount / kernelSeconds / 1e6, scalarSeconds / kernelSeconds);
+	};
+
+	printf("%zu actions (SSE2 %s, AVX %s)\n", actionCount, OFS_SSE2 ? "on" : "off", OFS_AVX ? "on" : "off");
+	run("OffsetTime",
+		[&]() noexcept { scalarOffsetTime(actions, 0.001f); },
+		[&]() noexcept { FunscriptActionKernels::OffsetTime(actions.data(), actions.size(), 0.001f); });
+	run("OffsetPosition",
+		[&]() noexcept { scalarOffsetPosition(actions, 7); },
+		[&]() noexcept { FunscriptActionKernels::OffsetPosition(actions.data(), actions.size(), 7); });
+	run("InvertPosition",
+		[&]() noexcept { scalarInvertPosition(actions); },
+		[&]() noexcept { FunscriptActionKernels::InvertPosition(actions.data(), actions.size()); });
+
+	// one sample per action over the whole script, the kernel includes copying into the SoA
+	std::vector<float> samples(actionCount);
+	float stepTime = ActionSpacing * 0.999f;
+	FunscriptActionSoA soa;
+	run("SampleLinear",
+		[&]() noexcept { scalarSampleLinear(actions, 0.f, stepTime, samples.data(), samples.size()); },
+		[&]() noexcept {
+			soa.LoadRange(array, 0.f, stepTime * samples.size(), 0);
+			FunscriptActionKernels::SampleLinear(soa, 0.f, stepTime, samples.data(), samples.size(),
+				array.back().pos, array.back().pos);
+		});
+	OFS_Bench::Keep(samples.back());
+	return 0;
+}
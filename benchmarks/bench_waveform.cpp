@@ -0,0 +1,71 @@
+// Feeds synthetic s16 mono PCM through WaveformLineBuilder the way OFS_Waveform::GenerateFromVideo does
+// and compares it to the plain per sample loop it replaced.
+// usage: bench_waveform [minutes of audio, default 30]
+#include "OFS_Bench.h"
+#include "OFS_Waveform.h"
+#include "OFS_Simd.h"
+
+#include <cstdio>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+
+// the loop LoadFlac used before WaveformLineBuilder
+static void scalarLines(const std::vector<int16_t>& pcm, std::vector<float>& outLines) noexcept
+{
+	constexpr int SamplesPerLine = OFS_Waveform::SamplesPerLine;
+	float avgSample = 0.f;
+	int sampleCount = 0;
+	for (auto sample : pcm) {
+		avgSample += std::abs(sample / 32768.f);
+		if (++sampleCount == SamplesPerLine) {
+			outLines.emplace_back(avgSample / SamplesPerLine);
+			avgSample = 0.f;
+			sampleCount = 0;
+		}
+	}
+}
+
+static void builderLines(const std::vector<int16_t>& pcm, std::vector<float>& outLines) noexcept
+{
+	// same chunk size as GenerateFromVideo reads from ffmpeg
+	constexpr size_t ChunkSize = OFS_Waveform::SampleRate;
+	WaveformLineBuilder builder;
+	for (size_t i = 0; i < pcm.size(); i += ChunkSize) {
+		builder.Add(pcm.data() + i, std::min(ChunkSize, pcm.size() - i), outLines);
+	}
+	builder.Finish(outLines);
+}
+
+int main(int argc, char* argv[])
+{
+	long minutes = OFS_Bench::Arg(argc, argv, 30);
+	size_t sampleCount = (size_t)minutes * 60 * OFS_Waveform::SampleRate;
+
+	std::vector<int16_t> pcm(sampleCount);
+	OFS_Bench::Random random;
+	for (size_t i = 0; i < pcm.size(); i += 1) {
+		// a slowly changing tone plus noise, the values don't change the speed but keep it realistic
+		float envelope = 0.5f + 0.5f * std::sin(i * 0.00001f);
+		float value = envelope * std::sin(i * 0.05f) * 0.8f + (random.NextFloat() - 0.5f) * 0.2f;
+		pcm[i] = (int16_t)std::clamp(value * 32767.f, -32768.f, 32767.f);
+	}
+
+	std::vector<float> lines;
+	lines.reserve(sampleCount / OFS_Waveform::SamplesPerLine + 1);
+	auto run = [&](const char* name, auto&& fn) noexcept {
+		double seconds = OFS_Bench::Best(5, [&]() noexcept {
+			lines.clear();
+			fn(pcm, lines);
+		});
+		OFS_Bench::Keep(lines.back());
+		printf("%-22s %8.1f Msamples/s (%.1f ms)\n", name, sampleCount / seconds / 1e6, seconds * 1000.0);
+		return seconds;
+	};
+
+	printf("%ld minutes of 48kHz audio, %zu samples\n", minutes, sampleCount);
+	double scalar = run("per sample loop", scalarLines);
+	double builder = run("WaveformLineBuilder", builderLines);
+	printf("speedup %.2fx (SSE2 %s)\n", scalar / builder, OFS_SSE2 ? "on" : "off");
+	return 0;
+}
@@ -0,0 +1,16 @@
+#pragma once
+#include "OFS_Project.h"
+
+#include "SDL_thread.h"
+#include "SDL_atomic.h"
+
+#include <memory>
+
+// an auto backup which is written on a worker thread
+// defined in its own header so OpenFunscripter can hold it in a unique_ptr
+struct AutoBackupJob
+{
+    std::unique_ptr<OFS_ProjectSave> save;
+    SDL_Thread* thread = nullptr;
+    SDL_atomic_t done = { 0 };
+};
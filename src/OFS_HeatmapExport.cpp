@@ -0,0 +1,156 @@
+#include "OFS_HeatmapExport.h"
+#include "OFS_Util.h"
+#include "OFS_Profiling.h"
+#include "OFS_FileLogging.h"
+#include "Funscript.h"
+#include "FunscriptHeatmap.h"
+
+#include <atomic>
+#include <cstring>
+#include <filesystem>
+
+#include "SDL_thread.h"
+#include "SDL_cpuinfo.h"
+
+struct HeatmapExportJob
+{
+    const OFS_HeatmapExport* settings = nullptr;
+    std::vector<std::filesystem::path> files;
+    std::atomic<uint32_t> nextFile = 0;
+    std::atomic<int32_t> failed = 0;
+};
+
+static bool exportHeatmap(const OFS_HeatmapExport& settings, const std::filesystem::path& file) noexcept
+{
+    OFS_PROFILE(__FUNCTION__);
+    auto filePath = file.u8string();
+    auto jsonText = Util::ReadFileString(filePath.c_str());
+
+    Funscript script;
+    Funscript::Metadata metadata;
+    if (jsonText.empty() || !script.Deserialize(jsonText, &metadata, false)) {
+        LOGF_ERROR("Failed to load \"%s\"", filePath.c_str());
+        return false;
+    }
+
+    // there is no video so the duration comes from the metadata or the last action
+    auto& actions = script.Actions();
+    float duration = metadata.duration > 0 ? (float)metadata.duration : 0.f;
+    if (!actions.empty()) {
+        duration = Util::Max(duration, actions.back().atS);
+    }
+    if (duration <= 0.f) {
+        LOGF_WARN("Skipping \"%s\" it has no actions.", filePath.c_str());
+        return true;
+    }
+
+    auto bitmap = FunscriptHeatmap::RenderToBitmap(duration, actions, settings.width, settings.height);
+    auto pngPath = Util::PathFromString(settings.outputDir) / file.filename();
+    pngPath.replace_extension(".png");
+    auto pngPathStr = pngPath.u8string();
+    if (!Util::SavePNG(pngPathStr, bitmap.data(), settings.width, settings.height, 4)) {
+        LOGF_ERROR("Failed to write \"%s\"", pngPathStr.c_str());
+        return false;
+    }
+    LOGF_INFO("Exported \"%s\"", pngPathStr.c_str());
+    return true;
+}
+
+static int exportThread(void* data) noexcept
+{
+    auto& job = *(HeatmapExportJob*)data;
+    for (uint32_t i = job.nextFile++; i < job.files.size(); i = job.nextFile++) {
+        if (!exportHeatmap(*job.settings, job.files[i])) {
+            job.failed += 1;
+        }
+    }
+    return 0;
+}
+
+bool OFS_HeatmapExport::IsCli(int argc, char* argv[]) noexcept
+{
+    return argc > 1 && std::strcmp(argv[1], CliFlag) == 0;
+}
+
+bool OFS_HeatmapExport::ParseArgs(int argc, char* argv[]) noexcept
+{
+    if (!IsCli(argc, argv) || argc < 3) {
+        return false;
+    }
+    inputDir = argv[2];
+    outputDir = inputDir;
+
+    for (int i = 3; i + 1 < argc; i += 2) {
+        const char* arg = argv[i];
+        const char* value = argv[i + 1];
+        if (std::strcmp(arg, "--output") == 0) {
+            outputDir = value;
+        }
+        else if (std::strcmp(arg, "--width") == 0) {
+            width = std::atoi(value);
+        }
+        else if (std::strcmp(arg, "--height") == 0) {
+            height = std::atoi(value);
+        }
+        else {
+            LOGF_ERROR("Unknown argument \"%s\"", arg);
+            return false;
+        }
+    }
+    width = Util::Clamp<int32_t>(width, 1, FunscriptHeatmap::MaxResolution);
+    height = Util::Clamp<int32_t>(height, 1, FunscriptHeatmap::MaxResolution);
+    return true;
+}
+
+int32_t OFS_HeatmapExport::Run() noexcept
+{
+    OFS_PROFILE(__FUNCTION__);
+    HeatmapExportJob job;
+    job.settings = this;
+
+    std::error_code ec;
+    std::filesystem::directory_iterator dirIt(Util::PathFromString(inputDir), ec);
+    for (auto& entry : dirIt) {
+        if (entry.is_regular_file(ec) && entry.path().extension() == Funscript::Extension) {
+            job.files.emplace_back(entry.path());
+        }
+    }
+    if (ec || job.files.empty()) {
+        LOGF_ERROR("No funscripts found in \"%s\"", inputDir.c_str());
+        return 1;
+    }
+    if (!Util::DirectoryExists(outputDir) && !Util::CreateDirectories(Util::PathFromString(outputDir))) {
+        LOGF_ERROR("Failed to create \"%s\"", outputDir.c_str());
+        return 1;
+    }
+
+    // every file is independent so each thread just grabs the next one
+    int threadCount = Util::Clamp<int>(SDL_GetCPUCount(), 1, job.files.size());
+    std::vector<SDL_Thread*> threads;
+    for (int i = 1; i < threadCount; i += 1) {
+        threads.emplace_back(SDL_CreateThread(exportThread, "HeatmapExport", &job));
+    }
+    exportThread(&job);
+    for (auto thread : threads) {
+        SDL_WaitThread(thread, nullptr);
+    }
+
+    LOGF_INFO("Exported %u of %u heatmaps.", (uint32_t)(job.files.size() - job.failed), (uint32_t)job.files.size());
+    return job.failed;
+}
+
+int OFS_HeatmapExport::RunCli(int argc, char* argv[]) noexcept
+{
+    // OFS.log belongs to the last GUI session
+    OFS_FileLogger::Init("OFS_HeatmapExport.log");
+    int result = 1;
+    OFS_HeatmapExport exporter;
+    if (exporter.ParseArgs(argc, argv)) {
+        result = exporter.Run() == 0 ? 0 : 1;
+    }
+    else {
+        LOGF_ERROR("Usage: %s <directory> [--output <directory>] [--width <px>] [--height <px>]", CliFlag);
+    }
+    OFS_FileLogger::Shutdown();
+    return result;
+}
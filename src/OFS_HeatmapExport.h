@@ -0,0 +1,23 @@
+#pragma once
+#include <string>
+#include <cstdint>
+
+// Exports heatmap PNGs for a directory of funscripts without opening a window.
+// OpenFunscripter --export-heatmaps <directory> [--output <directory>] [--width <px>] [--height <px>]
+class OFS_HeatmapExport
+{
+public:
+    static constexpr const char* CliFlag = "--export-heatmaps";
+
+    std::string inputDir;
+    std::string outputDir;
+    int32_t width = 2000;
+    int32_t height = 50;
+
+    bool ParseArgs(int argc, char* argv[]) noexcept;
+    // renders every script on all cores, returns the number of files which failed
+    int32_t Run() noexcept;
+
+    static bool IsCli(int argc, char* argv[]) noexcept;
+    static int RunCli(int argc, char* argv[]) noexcept;
+};
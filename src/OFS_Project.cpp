@@ -1,4 +1,5 @@
 #include "OFS_Project.h"
+#include "OFS_ProjectFile.h"
 #include "OFS_Localization.h"
 #include "OFS_ImGui.h"
 #include "OFS_DynamicFontAtlas.h"
@@ -6,8 +7,10 @@
 #include "OFS_EventSystem.h"
 
 #include "subprocess.h"
+#include "SDL_thread.h"
 
 #include <algorithm>
+#include <string_view>
 
 static std::array<const char*, 6> VideoExtensions{
     ".mp4",
@@ -98,43 +101,106 @@ void OFS_Project::loadNecessaryGlyphs() noexcept
     OFS_DynFontAtlas::AddText(lastPath);
 }
 
+inline static size_t hashSection(const uint8_t* data, size_t size) noexcept
+{
+    return std::hash<std::string_view>()(std::string_view((const char*)data, size));
+}
+
 bool OFS_Project::Load(const std::string& path) noexcept
 {
     FUN_ASSERT(!valid, "Can't import if project is already loaded.");
-#if 1
-    std::vector<uint8_t> projectBin;
-    if (Util::ReadFile(path.c_str(), projectBin) > 0) {
-        bool succ;
-        auto projectState = Util::ParseCBOR(projectBin, &succ);
-        if (succ) {
-            valid = OFS_StateManager::Get()->DeserializeProjectAll(projectState, true);
-        }
+    OFS_ProjectFile projectFile;
+    if (projectFile.Open(path)) {
+        valid = loadChunked(path, projectFile);
     }
-#else
-    std::string projectJson = Util::ReadFileString(path.c_str());
-    if (!projectJson.empty()) {
-        bool succ;
-        auto json = Util::ParseJson(projectJson, &succ);
-        if (succ) {
-            valid = OFS_StateManager::Get()->DeserializeProjectAll(json, false);
-        }
-        else {
-            valid = false;
-            addError("Failed to parse project.\nIt likely is an old project file not supported in " OFS_LATEST_GIT_TAG);
-        }
+    else if (projectFile.File().IsOpen() && !OFS_ProjectFile::IsChunked(projectFile.File().Data(), projectFile.File().Size())) {
+        // projects saved before the chunked format are a single CBOR document
+        valid = loadLegacy(ByteView{ projectFile.File().Data(), projectFile.File().Size() });
     }
-#endif
 
     if (valid) {
-        auto& projectState = State();
-        OFS_Binary::Deserialize(projectState.binaryFunscriptData, *this);
         lastPath = path;
         loadNecessaryGlyphs();
     }
+    else {
+        addError("Failed to load project.");
+    }
 
     return valid;
 }
 
+bool OFS_Project::loadChunked(const std::string& path, const OFS_ProjectFile& projectFile) noexcept
+{
+    OFS_PROFILE(__FUNCTION__);
+    // the next save only appends what changed since loading
+    auto& journal = journals[0];
+    journal = OFS_ProjectSave::Journal();
+
+    // the state manager expects all states in one object, they are small without the funscripts
+    nlohmann::json projectState = nlohmann::json::object();
+    projectFile.ForEach(OFS_ProjectFile::StateSection,
+        [&projectState, &journal](const OFS_ProjectFile::Section& section, ByteView view) noexcept {
+            journal.stateHashes.emplace(section.name, hashSection(view.data, view.size));
+            try {
+                projectState[section.name] = nlohmann::json::from_cbor(view.data, view.data + view.size);
+            }
+            catch (const std::exception& e) {
+                LOGF_ERROR("Failed to load \"%s\" state. %s", section.name, e.what());
+            }
+        });
+    if (!OFS_StateManager::Get()->DeserializeProjectAll(projectState, true)) {
+        return false;
+    }
+
+    bool succ = true;
+    Funscripts.clear();
+    projectFile.ForEach(OFS_ProjectFile::FunscriptSection,
+        [this, &succ](const OFS_ProjectFile::Section& section, ByteView view) noexcept {
+            auto script = std::make_shared<Funscript>();
+            if (OFS_Binary::Deserialize(view, *script) != bitsery::ReaderError::NoError) {
+                LOG_ERROR("Failed to load funscript from project.");
+                succ = false;
+            }
+            Funscripts.emplace_back(std::move(script));
+        });
+    if (Funscripts.empty()) {
+        Funscripts.emplace_back(std::make_shared<Funscript>());
+    }
+
+    if (succ) {
+        journal.path = path;
+        journal.compactedSize = projectFile.JournalOffset();
+        // appending after the remains of an interrupted save would hide every later block
+        // from readJournal, the next save rewrites the file instead
+        journal.fileSize = projectFile.ValidSize() == projectFile.File().Size() ? projectFile.ValidSize() : 0;
+        for (auto& script : Funscripts) {
+            journal.scripts.emplace_back(OFS_ProjectSave::SavedScript{ script, script->Revision(), script->Enabled });
+        }
+    }
+    return succ;
+}
+
+bool OFS_Project::loadLegacy(ByteView projectBin) noexcept
+{
+    OFS_PROFILE(__FUNCTION__);
+    bool loaded = false;
+    try {
+        auto projectState = nlohmann::json::from_cbor(projectBin.data, projectBin.data + projectBin.size);
+        loaded = OFS_StateManager::Get()->DeserializeProjectAll(projectState, true);
+    }
+    catch (const std::exception& e) {
+        LOGF_ERROR("%s", e.what());
+    }
+
+    if (loaded) {
+        auto& projectState = State();
+        OFS_Binary::Deserialize(projectState.binaryFunscriptData, *this);
+        // only the old format stores the scripts in the project state
+        projectState.binaryFunscriptData = std::vector<uint8_t>();
+    }
+    return loaded;
+}
+
 bool OFS_Project::ImportFromFunscript(const std::string& file) noexcept
 {
     FUN_ASSERT(!valid, "Can't import if project is already loaded.");
@@ -145,11 +211,10 @@ bool OFS_Project::ImportFromFunscript(const std::string& file) noexcept
 
     if (Util::FileExists(file)) {
         Funscripts.clear();
-        if (!AddFunscript(file)) {
+        if (!addFunscriptWithAxes(file)) {
             addError("Failed to load funscript.");
             return valid;
         }
-        loadMultiAxis(file);
 
         std::string absMediaPath;
         if (FindMedia(file, &absMediaPath)) {
@@ -187,8 +252,7 @@ bool OFS_Project::ImportFromMedia(const std::string& file) noexcept
         auto funscriptPathStr = funscriptPath.replace_extension(".funscript").u8string();
 
         Funscripts.clear();
-        AddFunscript(funscriptPathStr);
-        loadMultiAxis(funscriptPathStr);
+        addFunscriptWithAxes(funscriptPathStr);
         valid = true;
         loadNecessaryGlyphs();
     }
@@ -196,19 +260,28 @@ bool OFS_Project::ImportFromMedia(const std::string& file) noexcept
     return valid;
 }
 
-bool OFS_Project::AddFunscript(const std::string& path) noexcept
+// Only touches the script, so this can run on any thread as long as loadChapters is false.
+static bool readFunscript(const std::string& path, Funscript& script, Funscript::Metadata& metadata, bool loadChapters) noexcept
 {
-    bool loadedScript = false;
-
-    bool succ = false;
+    OFS_PROFILE(__FUNCTION__);
     auto jsonText = Util::ReadFileString(path.c_str());
-    auto json = Util::ParseJson(jsonText, &succ);
+    return !jsonText.empty() && script.Deserialize(jsonText, &metadata, loadChapters);
+}
 
+bool OFS_Project::AddFunscript(const std::string& path) noexcept
+{
     auto script = std::make_shared<Funscript>();
     auto metadata = Funscript::Metadata();
 
     bool isFirstFunscript = Funscripts.size() == 0;
-    if (succ && script->Deserialize(json, &metadata, isFirstFunscript)) {
+    bool loadedScript = readFunscript(path, *script, metadata, isFirstFunscript);
+    return insertFunscript(path, std::move(script), metadata, loadedScript);
+}
+
+bool OFS_Project::insertFunscript(const std::string& path, std::shared_ptr<Funscript>&& script, const Funscript::Metadata& metadata, bool loaded) noexcept
+{
+    bool isFirstFunscript = Funscripts.size() == 0;
+    if (loaded) {
         // Add existing script to project
         script = Funscripts.emplace_back(std::move(script));
         script->UpdateRelativePath(MakePathRelative(path));
@@ -217,7 +290,6 @@ bool OFS_Project::AddFunscript(const std::string& path) noexcept
             auto& projectState = State();
             projectState.metadata = metadata;
         }
-        loadedScript = true;
     }
     else {
         // Add empty script to project
@@ -225,7 +297,7 @@ bool OFS_Project::AddFunscript(const std::string& path) noexcept
         script->UpdateRelativePath(MakePathRelative(path));
         script = Funscripts.emplace_back(std::move(script));
     }
-    return loadedScript;
+    return loaded;
 }
 
 void OFS_Project::RemoveFunscript(int32_t idx) noexcept
@@ -236,24 +308,106 @@ void OFS_Project::RemoveFunscript(int32_t idx) noexcept
     }
 }
 
+bool OFS_Project::canAppend(const OFS_ProjectSave::Journal& journal, const std::string& path) const noexcept
+{
+    if (journal.path != path || journal.fileSize == 0) return false;
+    // compact once the journal outgrows the rest of the file
+    if (journal.fileSize - journal.compactedSize > journal.compactedSize) return false;
+    // scripts are stored by index, adding or removing one needs a full save
+    if (journal.scripts.size() != Funscripts.size()) return false;
+    for (size_t i = 0; i < Funscripts.size(); i += 1) {
+        if (journal.scripts[i].script.lock() != Funscripts[i]) return false;
+    }
+    return true;
+}
+
+std::unique_ptr<OFS_ProjectSave> OFS_Project::PrepareSave(const std::string& path) noexcept
+{
+    OFS_PROFILE(__FUNCTION__);
+    auto save = std::make_unique<OFS_ProjectSave>();
+    auto& journal = journalFor(path);
+    save->path = path;
+    save->incremental = canAppend(journal, path);
+    save->journal = journal;
+    // project states are tiny compared to the scripts, Write hashes them instead of tracking changes
+    save->projectState = OFS_StateManager::Get()->SerializeProjectAll(true);
+
+    save->savedScripts.reserve(Funscripts.size());
+    for (size_t i = 0; i < Funscripts.size(); i += 1) {
+        auto& script = Funscripts[i];
+        save->savedScripts.emplace_back(OFS_ProjectSave::SavedScript{ script, script->Revision(), script->Enabled });
+        if (save->incremental) {
+            auto& saved = journal.scripts[i];
+            if (saved.revision == script->Revision() && saved.enabled == script->Enabled) continue;
+        }
+        save->scripts.emplace_back(i, script->MakeProjectSnapshot());
+    }
+    return save;
+}
+
+void OFS_Project::FinishSave(OFS_ProjectSave& save) noexcept
+{
+    journalFor(save.path) = std::move(save.journal);
+}
+
+bool OFS_ProjectSave::Write() noexcept
+{
+    OFS_PROFILE(__FUNCTION__);
+    OFS_ProjectFileWriter writer;
+    std::map<std::string, size_t> stateHashes;
+    for (auto& state : projectState.items()) {
+        auto stateBin = Util::SerializeCBOR(state.value());
+        auto hash = hashSection(stateBin.data(), stateBin.size());
+        stateHashes.emplace(state.key(), hash);
+        if (incremental) {
+            auto it = journal.stateHashes.find(state.key());
+            if (it != journal.stateHashes.end() && it->second == hash) continue;
+        }
+        writer.AddSection(OFS_ProjectFile::StateSection, state.key(), std::move(stateBin));
+    }
+
+    for (auto& [index, script] : scripts) {
+        ByteBuffer buffer;
+        auto size = OFS_Binary::Serialize(buffer, script);
+        buffer.resize(size);
+        writer.AddSection(OFS_ProjectFile::FunscriptSection, std::to_string(index), std::move(buffer));
+    }
+
+    uint64_t fileSize = 0;
+    if (!incremental) {
+        fileSize = writer.Write(path);
+        journal.compactedSize = fileSize;
+    }
+    else if (writer.Empty()) {
+        fileSize = journal.fileSize;
+    }
+    else {
+        fileSize = writer.Append(path, journal.fileSize);
+    }
+
+    if (fileSize == 0) {
+        // the next save rewrites the whole file
+        journal = Journal();
+        return false;
+    }
+    journal.path = path;
+    journal.fileSize = fileSize;
+    journal.scripts = std::move(savedScripts);
+    journal.stateHashes = std::move(stateHashes);
+    return true;
+}
+
 void OFS_Project::Save(const std::string& path, bool clearUnsavedChanges) noexcept
 {
-    {
-        auto& projectState = State();
-        projectState.binaryFunscriptData.clear();
-        auto size = OFS_Binary::Serialize(projectState.binaryFunscriptData, *this);
-        projectState.binaryFunscriptData.resize(size);
-    }
-
-#if 1
-    auto projectState = OFS_StateManager::Get()->SerializeProjectAll(true);
-    auto projectBin = Util::SerializeCBOR(projectState);
-    Util::WriteFile(path.c_str(), projectBin.data(), projectBin.size());
-#else
-    auto projectState = OFS_StateManager::Get()->SerializeProjectAll(false);
-    auto projectJson = Util::SerializeJson(projectState, false);
-    Util::WriteFile(path.c_str(), projectJson.data(), projectJson.size());
-#endif
+    OFS_PROFILE(__FUNCTION__);
+    auto save = PrepareSave(path);
+    if (!save->Write() && save->incremental) {
+        FinishSave(*save);
+        save = PrepareSave(path);
+        save->Write();
+    }
+    FinishSave(*save);
+
     if (clearUnsavedChanges) {
         for (auto& script : Funscripts) {
             script->ClearUnsavedEdits();
@@ -261,6 +415,23 @@ void OFS_Project::Save(const std::string& path, bool clearUnsavedChanges) noexce
     }
 }
 
+bool OFS_Project::MoveSave(const std::string& fromPath, const std::string& toPath) noexcept
+{
+    for (auto& journal : journals) {
+        if (journal.path != fromPath) continue;
+        std::error_code ec;
+        std::filesystem::rename(Util::PathFromString(fromPath), Util::PathFromString(toPath), ec);
+        if (ec) {
+            LOGF_ERROR("%s", ec.message().c_str());
+            journal = OFS_ProjectSave::Journal();
+            return false;
+        }
+        journal.path = toPath;
+        return true;
+    }
+    return false;
+}
+
 void OFS_Project::Update(float delta, bool idleMode) noexcept
 {
     if (!idleMode) {
@@ -327,9 +498,8 @@ void OFS_Project::ExportFunscripts() noexcept
     for (auto& script : Funscripts) {
         FUN_ASSERT(!script->RelativePath().empty(), "path is empty");
         if (!script->RelativePath().empty()) {
-            auto json = script->Serialize(state.metadata, true);
+            auto jsonText = script->SerializeText(state.metadata, true);
             script->ClearUnsavedEdits();
-            auto jsonText = Util::SerializeJson(json, false);
             Util::WriteFile(MakePathAbsolute(script->RelativePath()).c_str(), jsonText.data(), jsonText.size());
         }
     }
@@ -343,9 +513,8 @@ void OFS_Project::ExportFunscripts(const std::string& outputDir) noexcept
         if (!script->RelativePath().empty()) {
             auto filename = Util::PathFromString(script->RelativePath()).filename();
             auto outputPath = (Util::PathFromString(outputDir) / filename).u8string();
-            auto json = script->Serialize(state.metadata, true);
+            auto jsonText = script->SerializeText(state.metadata, true);
             script->ClearUnsavedEdits();
-            auto jsonText = Util::SerializeJson(json, false);
             Util::WriteFile(outputPath.c_str(), jsonText.data(), jsonText.size());
         }
     }
@@ -355,16 +524,32 @@ void OFS_Project::ExportFunscript(const std::string& outputPath, int32_t idx) no
 {
     FUN_ASSERT(idx >= 0 && idx < Funscripts.size(), "out of bounds");
     auto& state = State();
-    auto json = Funscripts[idx]->Serialize(state.metadata, true);
+    auto jsonText = Funscripts[idx]->SerializeText(state.metadata, true);
     Funscripts[idx]->ClearUnsavedEdits();
     // Using this function changes the default path
     Funscripts[idx]->UpdateRelativePath(MakePathRelative(outputPath));
-    auto jsonText = Util::SerializeJson(json, false);
     Util::WriteFile(outputPath.c_str(), jsonText.data(), jsonText.size());
 }
 
-void OFS_Project::loadMultiAxis(const std::string& rootScript) noexcept
+struct AxisLoadJob {
+    std::string path;
+    std::shared_ptr<Funscript> script;
+    Funscript::Metadata metadata;
+    bool loaded = false;
+    SDL_Thread* thread = nullptr;
+};
+
+static int loadAxisThread(void* data) noexcept
+{
+    auto& job = *(AxisLoadJob*)data;
+    // chapters only get loaded from the root script
+    job.loaded = readFunscript(job.path, *job.script, job.metadata, false);
+    return 0;
+}
+
+bool OFS_Project::addFunscriptWithAxes(const std::string& rootScript) noexcept
 {
+    OFS_PROFILE(__FUNCTION__);
     std::vector<std::filesystem::path> relatedFiles;
     {
         auto filename = Util::Filename(rootScript) + '.';
@@ -409,12 +594,29 @@ void OFS_Project::loadMultiAxis(const std::string& rootScript) noexcept
             }
         }
     }
-    // load the related files
-    for (int i = relatedFiles.size() - 1; i >= 0; i -= 1) {
-        auto& file = relatedFiles[i];
-        auto filePathString = file.u8string();
-        AddFunscript(filePathString);
+
+    // every axis is read and parsed on its own thread, there are rarely more than a handful
+    // the results are added in the same order as before once all threads are done
+    std::vector<AxisLoadJob> jobs(relatedFiles.size());
+    for (int i = relatedFiles.size() - 1, j = 0; i >= 0; i -= 1, j += 1) {
+        auto& job = jobs[j];
+        job.path = relatedFiles[i].u8string();
+        job.script = std::make_shared<Funscript>();
+        job.thread = SDL_CreateThread(loadAxisThread, "OFS_LoadAxis", &job);
+        if (!job.thread) {
+            loadAxisThread(&job);
+        }
+    }
+
+    bool loadedRoot = AddFunscript(rootScript);
+
+    for (auto& job : jobs) {
+        if (job.thread) {
+            SDL_WaitThread(job.thread, nullptr);
+        }
+        insertFunscript(job.path, std::move(job.script), job.metadata, job.loaded);
     }
+    return loadedRoot;
 }
 
 std::string OFS_Project::MakePathAbsolute(const std::string& relPathStr) const noexcept
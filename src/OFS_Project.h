@@ -7,6 +7,8 @@
 #include <memory>
 #include <cstdint>
 #include <string>
+#include <array>
+#include <map>
 
 class ProjectLoadedEvent: public OFS_Event<ProjectLoadedEvent> {
 public:
@@ -15,6 +17,37 @@ public:
 
 #define OFS_PROJECT_EXT ".ofsp"
 
+class OFS_ProjectFile;
+
+// Everything a project save needs, taken on the main thread by OFS_Project::PrepareSave.
+// Write doesn't touch the project so it can run on any thread.
+struct OFS_ProjectSave {
+    struct SavedScript {
+        std::weak_ptr<Funscript> script;
+        uint32_t revision;
+        bool enabled;
+    };
+    // what the last save wrote to a file, so the next save only has to append what changed
+    struct Journal {
+        std::string path;
+        uint64_t compactedSize = 0;
+        uint64_t fileSize = 0;
+        std::vector<SavedScript> scripts;
+        std::map<std::string, size_t> stateHashes;
+    };
+
+    std::string path;
+    bool incremental = false;
+    // the journal before saving, Write replaces it with the new one
+    Journal journal;
+    nlohmann::json projectState;
+    // index into Funscripts and a copy of the scripts which need to be written
+    std::vector<std::pair<uint32_t, Funscript::ProjectSnapshot>> scripts;
+    std::vector<SavedScript> savedScripts;
+
+    bool Write() noexcept;
+};
+
 class OFS_Project {
 private:
     uint32_t stateHandle = 0xFFFF'FFFF;
@@ -25,6 +58,10 @@ private:
     std::string notValidError;
     bool valid = false;
 
+    // the project file and the auto backup
+    std::array<OFS_ProjectSave::Journal, 2> journals;
+    inline OFS_ProjectSave::Journal& journalFor(const std::string& path) noexcept { return path == lastPath ? journals[0] : journals[1]; }
+
     void addError(const std::string& error) noexcept
     {
         valid = false;
@@ -32,7 +69,14 @@ private:
         notValidError += error;
     }
     void loadNecessaryGlyphs() noexcept;
-    void loadMultiAxis(const std::string& rootScript) noexcept;
+    bool loadChunked(const std::string& path, const OFS_ProjectFile& projectFile) noexcept;
+    bool loadLegacy(ByteView projectBin) noexcept;
+    bool canAppend(const OFS_ProjectSave::Journal& journal, const std::string& path) const noexcept;
+    // adds rootScript followed by its other axes, the axes are parsed on worker threads
+    // while rootScript is loaded, returns if rootScript could be loaded
+    bool addFunscriptWithAxes(const std::string& rootScript) noexcept;
+    // main thread part of AddFunscript, adds an empty script if it wasn't loaded
+    bool insertFunscript(const std::string& path, std::shared_ptr<Funscript>&& script, const Funscript::Metadata& metadata, bool loaded) noexcept;
 
 public:
     static constexpr auto Extension = OFS_PROJECT_EXT;
@@ -47,6 +91,12 @@ public:
     bool Load(const std::string& path) noexcept;
     void Save(bool clearUnsavedChanges) noexcept { Save(lastPath, clearUnsavedChanges); }
     void Save(const std::string& path, bool clearUnsavedChanges) noexcept;
+    // renames a file written by Save, later saves to the new path keep appending to it
+    bool MoveSave(const std::string& fromPath, const std::string& toPath) noexcept;
+    // Save split up so the file can be written on another thread
+    // only changed scripts are copied, unless the file has to be rewritten
+    std::unique_ptr<OFS_ProjectSave> PrepareSave(const std::string& path) noexcept;
+    void FinishSave(OFS_ProjectSave& save) noexcept;
 
     bool ImportFromFunscript(const std::string& path) noexcept;
     bool ImportFromMedia(const std::string& path) noexcept;
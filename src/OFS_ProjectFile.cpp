@@ -0,0 +1,226 @@
+#include "OFS_ProjectFile.h"
+#include "OFS_Util.h"
+#include "OFS_Profiling.h"
+
+#include <cstring>
+#include <algorithm>
+
+static constexpr char ProjectFileMagic[8] = { 'O', 'F', 'S', 'P', 'C', 'H', 'N', 'K' };
+static constexpr char JournalMagic[8] = { 'O', 'F', 'S', 'P', 'J', 'R', 'N', 'L' };
+// section data and journal blocks start on 8 byte boundaries
+static constexpr uint64_t SectionAlignment = 8;
+
+inline static uint64_t alignSection(uint64_t offset) noexcept
+{
+    return (offset + SectionAlignment - 1) & ~(SectionAlignment - 1);
+}
+
+inline static bool sectionInBounds(const OFS_ProjectFile::Section& section, uint64_t begin, uint64_t end) noexcept
+{
+    return section.offset >= begin && section.offset <= end && section.size <= end - section.offset;
+}
+
+bool OFS_ProjectFile::IsChunked(const uint8_t* data, size_t size) noexcept
+{
+    return size >= sizeof(Header) && memcmp(data, ProjectFileMagic, sizeof(ProjectFileMagic)) == 0;
+}
+
+bool OFS_ProjectFile::Open(const std::string& path) noexcept
+{
+    OFS_PROFILE(__FUNCTION__);
+    sections.clear();
+    if (!file.Open(path) || !IsChunked(file.Data(), file.Size())) {
+        return false;
+    }
+
+    Header header;
+    memcpy(&header, file.Data(), sizeof(Header));
+    if (header.version > Version) {
+        LOGF_ERROR("Project was saved with a newer version. (%u)", header.version);
+        return false;
+    }
+
+    uint64_t tableEnd = sizeof(Header) + (uint64_t)header.sectionCount * sizeof(Section);
+    if (tableEnd > header.journalOffset || header.journalOffset > file.Size()) {
+        LOG_ERROR("Project section table is truncated.");
+        return false;
+    }
+
+    sections.resize(header.sectionCount);
+    memcpy(sections.data(), file.Data() + sizeof(Header), header.sectionCount * sizeof(Section));
+    for (auto& section : sections) {
+        section.name[sizeof(section.name) - 1] = '\0';
+        if (!sectionInBounds(section, tableEnd, header.journalOffset)) {
+            LOGF_ERROR("Project section \"%s\" is out of bounds.", section.name);
+            sections.clear();
+            return false;
+        }
+    }
+    journalOffset = header.journalOffset;
+    readJournal();
+    return true;
+}
+
+void OFS_ProjectFile::readJournal() noexcept
+{
+    validSize = journalOffset;
+    uint64_t blockOffset = alignSection(journalOffset);
+    std::vector<Section> blockSections;
+    while (blockOffset + sizeof(JournalHeader) <= file.Size()) {
+        JournalHeader block;
+        memcpy(&block, file.Data() + blockOffset, sizeof(JournalHeader));
+        uint64_t tableEnd = blockOffset + sizeof(JournalHeader) + (uint64_t)block.sectionCount * sizeof(Section);
+        uint64_t blockEnd = blockOffset + block.size;
+        // a save which got interrupted leaves an incomplete block at the end
+        // everything before it is still consistent
+        if (memcmp(block.magic, JournalMagic, sizeof(JournalMagic)) != 0
+            || block.size < sizeof(JournalHeader) || blockEnd > file.Size() || blockEnd < blockOffset || tableEnd > blockEnd) {
+            LOGF_WARN("Ignoring incomplete project journal at %llu.", (unsigned long long)blockOffset);
+            return;
+        }
+
+        blockSections.resize(block.sectionCount);
+        memcpy(blockSections.data(), file.Data() + blockOffset + sizeof(JournalHeader), block.sectionCount * sizeof(Section));
+        for (auto& section : blockSections) {
+            section.name[sizeof(section.name) - 1] = '\0';
+            if (!sectionInBounds(section, tableEnd, blockEnd)) {
+                LOGF_WARN("Ignoring incomplete project journal at %llu.", (unsigned long long)blockOffset);
+                return;
+            }
+        }
+
+        for (auto& section : blockSections) {
+            auto it = std::find_if(sections.begin(), sections.end(),
+                [&section](auto& existing) noexcept { return existing.kind == section.kind && strcmp(existing.name, section.name) == 0; });
+            if (it != sections.end()) {
+                *it = section;
+            }
+            else {
+                sections.emplace_back(section);
+            }
+        }
+        validSize = blockEnd;
+        blockOffset = alignSection(blockEnd);
+    }
+}
+
+const OFS_ProjectFile::Section* OFS_ProjectFile::Find(SectionKind kind, const char* name) const noexcept
+{
+    for (auto& section : sections) {
+        if (section.kind == kind && strcmp(section.name, name) == 0) return &section;
+    }
+    return nullptr;
+}
+
+void OFS_ProjectFileWriter::AddSection(OFS_ProjectFile::SectionKind kind, const std::string& name, std::vector<uint8_t>&& data) noexcept
+{
+    auto& pending = sections.emplace_back();
+    memset(&pending.section, 0, sizeof(pending.section));
+    FUN_ASSERT(name.size() < sizeof(pending.section.name), "section name too long");
+    strncpy(pending.section.name, name.c_str(), sizeof(pending.section.name) - 1);
+    pending.section.kind = kind;
+    pending.section.size = data.size();
+    pending.data = std::move(data);
+}
+
+// writes header, section table and data starting at startOffset in the file
+// offsets in the table are absolute, returns the offset after the last section
+static uint64_t writeSections(SDL_RWops* file, uint64_t startOffset, const void* header, size_t headerSize,
+    std::vector<OFS_ProjectFileWriter::PendingSection>& sections, bool* succ) noexcept
+{
+    uint64_t offset = startOffset + headerSize + sections.size() * sizeof(OFS_ProjectFile::Section);
+    for (auto& pending : sections) {
+        offset = alignSection(offset);
+        pending.section.offset = offset;
+        offset += pending.section.size;
+    }
+
+    *succ = *succ && SDL_RWwrite(file, header, headerSize, 1) == 1;
+    for (auto& pending : sections) {
+        *succ = *succ && SDL_RWwrite(file, &pending.section, sizeof(pending.section), 1) == 1;
+    }
+
+    const uint8_t padding[SectionAlignment] = {};
+    uint64_t written = startOffset + headerSize + sections.size() * sizeof(OFS_ProjectFile::Section);
+    for (auto& pending : sections) {
+        auto paddingSize = pending.section.offset - written;
+        if (paddingSize > 0) {
+            *succ = *succ && SDL_RWwrite(file, padding, 1, paddingSize) == paddingSize;
+        }
+        if (!pending.data.empty()) {
+            *succ = *succ && SDL_RWwrite(file, pending.data.data(), 1, pending.data.size()) == pending.data.size();
+        }
+        written = pending.section.offset + pending.section.size;
+    }
+    return written;
+}
+
+uint64_t OFS_ProjectFileWriter::Write(const std::string& path) noexcept
+{
+    OFS_PROFILE(__FUNCTION__);
+    OFS_ProjectFile::Header header;
+    memcpy(header.magic, ProjectFileMagic, sizeof(header.magic));
+    header.version = OFS_ProjectFile::Version;
+    header.sectionCount = sections.size();
+    header.journalOffset = sizeof(header) + sections.size() * sizeof(OFS_ProjectFile::Section);
+    for (auto& pending : sections) {
+        header.journalOffset = alignSection(header.journalOffset) + pending.section.size;
+    }
+
+    auto file = Util::OpenFile(path.c_str(), "wb", path.size());
+    if (!file) {
+        LOGF_ERROR("Failed to open \"%s\" for writing.", path.c_str());
+        return 0;
+    }
+
+    bool succ = true;
+    auto size = writeSections(file, 0, &header, sizeof(header), sections, &succ);
+    FUN_ASSERT(size == header.journalOffset, "size mismatch");
+    SDL_RWclose(file);
+
+    if (!succ) {
+        LOGF_ERROR("Failed to write project \"%s\"", path.c_str());
+        return 0;
+    }
+    return size;
+}
+
+uint64_t OFS_ProjectFileWriter::Append(const std::string& path, uint64_t expectedSize) noexcept
+{
+    OFS_PROFILE(__FUNCTION__);
+    auto file = Util::OpenFile(path.c_str(), "r+b", path.size());
+    if (!file) {
+        return 0;
+    }
+    // someone else wrote to the file since the last save
+    if (SDL_RWseek(file, 0, RW_SEEK_END) != (Sint64)expectedSize) {
+        SDL_RWclose(file);
+        return 0;
+    }
+
+    bool succ = true;
+    uint64_t blockOffset = alignSection(expectedSize);
+    if (blockOffset != expectedSize) {
+        const uint8_t padding[SectionAlignment] = {};
+        succ = SDL_RWwrite(file, padding, 1, blockOffset - expectedSize) == blockOffset - expectedSize;
+    }
+
+    OFS_ProjectFile::JournalHeader block;
+    memcpy(block.magic, JournalMagic, sizeof(block.magic));
+    block.sectionCount = sections.size();
+    block.reserved = 0;
+    block.size = sizeof(block) + sections.size() * sizeof(OFS_ProjectFile::Section);
+    for (auto& pending : sections) {
+        block.size = alignSection(blockOffset + block.size) - blockOffset + pending.section.size;
+    }
+
+    auto size = writeSections(file, blockOffset, &block, sizeof(block), sections, &succ);
+    FUN_ASSERT(size == blockOffset + block.size, "size mismatch");
+    SDL_RWclose(file);
+
+    if (!succ) {
+        LOGF_ERROR("Failed to append to project \"%s\"", path.c_str());
+        return 0;
+    }
+    return size;
+}
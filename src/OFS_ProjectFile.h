@@ -0,0 +1,106 @@
+#pragma once
+#include "OFS_MappedFile.h"
+#include "OFS_BinarySerialization.h"
+
+#include <vector>
+#include <string>
+#include <cstdint>
+
+// Chunked .ofsp layout, everything is little endian.
+//
+// Header | Section[sectionCount] | section data | JournalBlock...
+// JournalBlock: JournalHeader | Section[sectionCount] | section data
+//
+// Every section can be read on its own without touching the rest of the file.
+// Project states are stored as one CBOR section each, every funscript gets a bitsery section
+// named after its index. Journal blocks are appended by incremental saves, a section in a
+// block replaces the earlier section with the same kind and name.
+// Projects saved before this format are a single CBOR document, see OFS_Project::Load.
+class OFS_ProjectFile
+{
+public:
+    static constexpr uint32_t Version = 1;
+
+    enum SectionKind : uint32_t {
+        StateSection = 1, // CBOR of { "TypeName": ..., "State": ... }
+        FunscriptSection = 2, // bitsery of a single Funscript, in project order
+    };
+
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t sectionCount;
+        uint64_t journalOffset; // end of the compacted part, journal blocks follow
+    };
+
+    struct JournalHeader {
+        char magic[8];
+        uint32_t sectionCount;
+        uint32_t reserved;
+        uint64_t size; // the whole block including this header
+    };
+
+    struct Section {
+        char name[40];
+        uint32_t kind;
+        uint32_t reserved;
+        uint64_t offset;
+        uint64_t size;
+    };
+
+    static_assert(sizeof(Header) == 24);
+    static_assert(sizeof(JournalHeader) == 24);
+    static_assert(sizeof(Section) == 64);
+
+    // checks the magic, anything else is treated as the old CBOR format
+    static bool IsChunked(const uint8_t* data, size_t size) noexcept;
+
+    bool Open(const std::string& path) noexcept;
+    inline const OFS_MappedFile& File() const noexcept { return file; }
+    // size of the compacted part of the file, everything after it is journal
+    inline uint64_t JournalOffset() const noexcept { return journalOffset; }
+    // end of the last complete journal block, anything after it was left by an interrupted save
+    inline uint64_t ValidSize() const noexcept { return validSize; }
+
+    // nullptr if there is no such section
+    const Section* Find(SectionKind kind, const char* name) const noexcept;
+    inline ByteView View(const Section& section) const noexcept { return ByteView{ file.Data() + section.offset, (size_t)section.size }; }
+
+    template<typename Fn>
+    inline void ForEach(SectionKind kind, Fn&& fn) const noexcept
+    {
+        for (auto& section : sections) {
+            if (section.kind == kind) fn(section, View(section));
+        }
+    }
+
+private:
+    OFS_MappedFile file;
+    std::vector<Section> sections;
+    uint64_t journalOffset = 0;
+    uint64_t validSize = 0;
+
+    void readJournal() noexcept;
+};
+
+class OFS_ProjectFileWriter
+{
+public:
+    struct PendingSection {
+        OFS_ProjectFile::Section section;
+        std::vector<uint8_t> data;
+    };
+
+private:
+    std::vector<PendingSection> sections;
+
+public:
+    void AddSection(OFS_ProjectFile::SectionKind kind, const std::string& name, std::vector<uint8_t>&& data) noexcept;
+    inline bool Empty() const noexcept { return sections.empty(); }
+
+    // writes a compacted project, returns the size of the file or 0 on failure
+    uint64_t Write(const std::string& path) noexcept;
+    // appends the sections as a journal block to a file written by Write or Append
+    // fails if the file isn't expectedSize bytes, returns the new size or 0 on failure
+    uint64_t Append(const std::string& path, uint64_t expectedSize) noexcept;
+};
@@ -344,7 +344,7 @@ inline void RecordingMode::singleAxisRecording() noexcept
 {
     OFS_PROFILE(__FUNCTION__);
     auto app = OpenFunscripter::ptr;
-    recordingAxisX->AddAction(FunscriptAction(app->player->CurrentTime(), currentPosY));
+    recordedX.emplace(FunscriptAction(app->player->CurrentTime(), currentPosY));
     app->simulator.positionOverride = currentPosY;
 }
 
@@ -354,8 +354,21 @@ inline void RecordingMode::twoAxisRecording() noexcept
     auto app = OpenFunscripter::ptr;
 
     float atS = app->player->CurrentTime();
-    recordingAxisX->AddAction(FunscriptAction(atS, currentPosX));
-    recordingAxisY->AddAction(FunscriptAction(atS, currentPosY));
+    recordedX.emplace(FunscriptAction(atS, currentPosX));
+    recordedY.emplace(FunscriptAction(atS, currentPosY));
+}
+
+void RecordingMode::flushRecording() noexcept
+{
+    OFS_PROFILE(__FUNCTION__);
+    if (recordingAxisX && !recordedX.empty()) {
+        recordingAxisX->AddMultipleActions(recordedX);
+    }
+    if (recordingAxisY && !recordedY.empty()) {
+        recordingAxisY->AddMultipleActions(recordedY);
+    }
+    recordedX.clear();
+    recordedY.clear();
 }
 
 // recording
@@ -529,6 +542,7 @@ void RecordingMode::DrawModeSettings() noexcept
         }
     }
     else if (!playing && recordingActive) {
+        flushRecording();
         recordingAxisX = nullptr;
         recordingAxisY = nullptr;
         recordingActive = false;
@@ -557,6 +571,8 @@ void RecordingMode::Update() noexcept
         else {
             singleAxisRecording();
         }
+        // every frame so the timeline and the other axis follow the recording live
+        flushRecording();
     }
 }
 
@@ -565,6 +581,7 @@ void RecordingMode::Finish() noexcept
     OFS_PROFILE(__FUNCTION__);
     // this fixes a bug when the mode gets changed during a recording
     if (recordingActive) {
+        flushRecording();
         recordingAxisX = nullptr;
         recordingAxisY = nullptr;
         recordingActive = false;
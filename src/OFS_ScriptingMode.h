@@ -91,10 +91,16 @@ private:
     std::shared_ptr<Funscript> recordingAxisX;
     std::shared_ptr<Funscript> recordingAxisY;
 
+    // the frame's recorded actions are merged into the scripts at the end of Update
+    // kept around so recording doesn't allocate every frame
+    FunscriptArray recordedX;
+    FunscriptArray recordedY;
+
     UnsubscribeFn eventUnsub;
 
     void singleAxisRecording() noexcept;
     void twoAxisRecording() noexcept;
+    void flushRecording() noexcept;
 
 public:
     // Attention: don't change order
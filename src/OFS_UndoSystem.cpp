@@ -4,6 +4,7 @@
 #include "OFS_Localization.h"
 
 #include <array>
+#include <algorithm>
 
 // this array provides strings for the StateType enum
 // for this to work the order needs to be maintained
@@ -61,14 +62,69 @@ UndoSystem::UndoSystem() noexcept
 {
     RedoStack.reserve(100);
     UndoStack.reserve(1000);
+
+    // spilled states from a previous session are useless
+    // other instances which are still running keep theirs
+    UndoSpillFile::RemoveStaleDirectories();
+}
+
+void UndoSystem::EnforceMemoryBudget(const std::vector<std::shared_ptr<Funscript>>& scripts, size_t budgetBytes, bool spillToDisk) noexcept
+{
+    size_t memoryUsage = 0;
+    for (auto& script : scripts) {
+        memoryUsage += script->undoSystem->MemoryUsage();
+    }
+    if (memoryUsage <= budgetBytes) return;
+    OFS_PROFILE(__FUNCTION__);
+
+    if (spillFailed && (!spillToDisk || budgetBytes != spillFailedBudget)) {
+        spillFailed = false;
+    }
+    bool spill = spillToDisk && !spillFailed;
+
+    // compact down to 3/4 of the budget so this doesn't run every frame
+    size_t bytesToFree = memoryUsage - (budgetBytes - budgetBytes / 4);
+    std::vector<FunscriptUndoSystem*> undoSystems;
+    undoSystems.reserve(scripts.size());
+    for (auto& script : scripts) {
+        undoSystems.emplace_back(script->undoSystem.get());
+    }
+    std::sort(undoSystems.begin(), undoSystems.end(),
+        [](auto a, auto b) noexcept { return a->MemoryUsage() > b->MemoryUsage(); });
+
+    for (auto undo : undoSystems) {
+        auto freed = undo->Compact(bytesToFree, spill);
+        if (freed >= bytesToFree) break;
+        bytesToFree -= freed;
+    }
+
+    if (spillToDisk && !spillFailed && !spill) {
+        LOG_WARN("Spilling undo states to disk failed, keeping them in memory.");
+        spillFailed = true;
+        spillFailedBudget = budgetBytes;
+    }
 }
 
-void UndoSystem::ShowUndoRedoHistory(bool* open) noexcept
+void UndoSystem::ShowUndoRedoHistory(bool* open, const std::vector<std::shared_ptr<Funscript>>& scripts) noexcept
 {
     if (!*open) return;
     OFS_PROFILE(__FUNCTION__);
     ImGui::SetNextWindowSizeConstraints(ImVec2(200, 100), ImVec2(200, 200));
     ImGui::Begin(TR_ID(UndoSystem::WindowId, Tr::UNDO_REDO_HISTORY), open, ImGuiWindowFlags_AlwaysVerticalScrollbar | ImGuiWindowFlags_AlwaysAutoResize);
+
+    size_t memoryUsage = 0;
+    for (auto& script : scripts) {
+        memoryUsage += script->undoSystem->MemoryUsage();
+    }
+    size_t diskUsage = 0;
+    for (auto& script : scripts) {
+        diskUsage += script->undoSystem->DiskUsage();
+    }
+    ImGui::TextDisabled("%s: %s", TR(MEMORY_USAGE), Util::FormatBytes(memoryUsage));
+    if (diskUsage > 0) {
+        ImGui::TextDisabled("%s: %s", TR(DISK_USAGE), Util::FormatBytes(diskUsage));
+    }
+    ImGui::Separator();
     ImGui::TextDisabled(TR(REDO_STACK));
 
     for (auto it = RedoStack.begin(), end = RedoStack.end(); it != end; ++it) {
@@ -62,10 +62,16 @@ private:
     std::vector<UndoContext> RedoStack;
     void ClearRedo() noexcept;
 
+    // spilling stops after a failed write (e.g. disk full) until the budget or setting changes
+    bool spillFailed = false;
+    size_t spillFailedBudget = 0;
+
 public:
     UndoSystem() noexcept;
     static constexpr const char* WindowId = "###UNDO_REDO_HISTORY";
-    void ShowUndoRedoHistory(bool* open) noexcept;
+    void ShowUndoRedoHistory(bool* open, const std::vector<std::shared_ptr<class Funscript>>& scripts) noexcept;
+    // compresses/spills old states of the biggest scripts until the total is below budgetBytes
+    void EnforceMemoryBudget(const std::vector<std::shared_ptr<class Funscript>>& scripts, size_t budgetBytes, bool spillToDisk) noexcept;
 
     void Snapshot(StateType type, std::weak_ptr<const class Funscript> scriptToSnapshot, bool clearRedo = true) noexcept
     {
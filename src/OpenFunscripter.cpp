@@ -109,6 +109,7 @@ OpenFunscripter::~OpenFunscripter() noexcept
     scripting.reset();
     controllerInput.reset();
     specialFunctions.reset();
+    finishAutoBackup(true);
     LoadedProject.reset();
     playerWindow.reset();
 }
@@ -1369,11 +1370,13 @@ void OpenFunscripter::FunscriptChanged(const FunscriptActionsChangedEvent* ev) n
     for (int i = 0, size = LoadedFunscripts().size(); i < size; i += 1) {
         if (LoadedFunscripts()[i].get() == ptr) {
             extensions->ScriptChanged(i);
+            if (i == (int)LoadedProject->ActiveIdx()) {
+                heatmapChangedFrom = std::min(heatmapChangedFrom, ev->ChangedFrom);
+                heatmapChangedTo = std::max(heatmapChangedTo, ev->ChangedTo);
+            }
             break;
         }
     }
-
-    Status = Status | OFS_Status::OFS_GradientNeedsUpdate;
 }
 
 void OpenFunscripter::ScriptTimelineActionClicked(const FunscriptActionClickedEvent* ev) noexcept
@@ -1461,6 +1464,8 @@ void OpenFunscripter::update() noexcept
 
     if (LoadedProject->IsValid()) {
         LoadedProject->Update(delta, IdleMode);
+        const auto& prefState = PreferenceState::State(preferences->StateHandle());
+        undoSystem->EnforceMemoryBudget(LoadedFunscripts(), (size_t)prefState.undoMemoryBudgetMB * 1024 * 1024, prefState.undoSpillToDisk);
     }
 
     if (Status & OFS_Status::OFS_AutoBackup) {
@@ -1470,17 +1475,65 @@ void OpenFunscripter::update() noexcept
     webApi->Update();
 }
 
+static int autoBackupThread(void* data) noexcept
+{
+    auto& job = *(AutoBackupJob*)data;
+    auto startTime = SDL_GetPerformanceCounter();
+    auto savePath = Util::PathFromString(job.save->path);
+    auto backupDir = savePath.parent_path();
+    if (Util::CreateDirectories(backupDir)) {
+        std::vector<std::filesystem::path> oldBackups;
+        std::error_code ec;
+        auto iterator = std::filesystem::directory_iterator(backupDir, ec);
+        for (auto it = std::filesystem::begin(iterator); it != std::filesystem::end(iterator); ++it) {
+            if (it->path().has_extension()) {
+                // the last backup was already renamed to savePath
+                if (it->path().extension() == ".backup" && it->path() != savePath) {
+                    oldBackups.emplace_back(it->path());
+                }
+            }
+        }
+        for (auto& oldBackup : oldBackups) {
+            LOGF_INFO("Removing \"%s\"", oldBackup.u8string().c_str());
+            std::filesystem::remove(oldBackup, ec);
+            if (ec) {
+                LOGF_ERROR("%s", ec.message().c_str());
+            }
+        }
+
+        LOGF_INFO("Backup at \"%s\"", job.save->path.c_str());
+        job.save->Write();
+    }
+    auto duration = (float)(SDL_GetPerformanceCounter() - startTime) / (float)SDL_GetPerformanceFrequency();
+    LOGF_INFO("Writing the backup took %f seconds", duration);
+    SDL_AtomicSet(&job.done, 1);
+    return 0;
+}
+
+void OpenFunscripter::finishAutoBackup(bool wait) noexcept
+{
+    if (!backupJob) return;
+    if (!wait && !SDL_AtomicGet(&backupJob->done)) return;
+    if (backupJob->thread) {
+        SDL_WaitThread(backupJob->thread, nullptr);
+    }
+    LoadedProject->FinishSave(*backupJob->save);
+    backupJob.reset();
+}
+
 void OpenFunscripter::autoBackup() noexcept
 {
+    finishAutoBackup(false);
     if (!LoadedProject->IsValid()) {
         return;
     }
     std::chrono::duration<float> timeSinceBackup = std::chrono::steady_clock::now() - lastBackup;
-    if (timeSinceBackup.count() < AutoBackupIntervalSeconds) {
+    if (timeSinceBackup.count() < AutoBackupIntervalSeconds || backupJob) {
         return;
     }
     OFS_PROFILE(__FUNCTION__);
     lastBackup = std::chrono::steady_clock::now();
+    auto startTime = SDL_GetPerformanceCounter();
 
     auto backupDir = Util::PathFromString(Util::Prefpath("backup"));
     auto name = Util::Filename(player->VideoPath());
@@ -1498,29 +1551,28 @@ void OpenFunscripter::autoBackup() noexcept
 #else
     backupDir /= name;
 #endif
-    if (!Util::CreateDirectories(backupDir)) {
-        return;
-    }
-
-    std::error_code ec;
-    auto iterator = std::filesystem::directory_iterator(backupDir, ec);
-    for (auto it = std::filesystem::begin(iterator); it != std::filesystem::end(iterator); ++it) {
-        if (it->path().has_extension()) {
-            if (it->path().extension() == ".backup") {
-                LOGF_INFO("Removing \"%s\"", it->path().u8string().c_str());
-                std::filesystem::remove(it->path(), ec);
-                if (ec) {
-                    LOGF_ERROR("%s", ec.message().c_str());
-                }
-            }
-        }
-    }
 
     auto time = asap::now();
     auto fileName = Util::PathFromString(Util::Format("%s_%02d-%02d-%02d" OFS_PROJECT_EXT ".backup", name.c_str(), time.hour(), time.minute(), time.second()));
-    auto savePath = backupDir / fileName;
-    LOGF_INFO("Backup at \"%s\"", savePath.u8string().c_str());
-    LoadedProject->Save(savePath.u8string(), false);
+    auto savePath = (backupDir / fileName).u8string();
+
+    // the last backup gets renamed so the save only has to append what changed
+    if (!lastBackupPath.empty()) {
+        LoadedProject->MoveSave(lastBackupPath, savePath);
+    }
+    lastBackupPath = savePath;
+
+    // only the snapshot is taken on the main thread, everything else happens in autoBackupThread
+    backupJob = std::make_unique<AutoBackupJob>();
+    backupJob->save = LoadedProject->PrepareSave(savePath);
+    auto duration = (float)(SDL_GetPerformanceCounter() - startTime) / (float)SDL_GetPerformanceFrequency();
+    LOGF_INFO("Backup snapshot took %f seconds. %u of %u scripts changed.", duration,
+        (uint32_t)backupJob->save->scripts.size(), (uint32_t)LoadedProject->Funscripts.size());
+
+    backupJob->thread = SDL_CreateThread(autoBackupThread, "OFS_AutoBackup", backupJob.get());
+    if (!backupJob->thread) {
+        autoBackupThread(backupJob.get());
+    }
 }
 
 void OpenFunscripter::exitApp(bool force) noexcept
@@ -1586,7 +1638,7 @@ void OpenFunscripter::Step() noexcept
             ShowAboutWindow(&ShowAbout);
 
             specialFunctions->ShowFunctionsWindow(&ofsState.showSpecialFunctions);
-            undoSystem->ShowUndoRedoHistory(&ofsState.showHistory);
+            undoSystem->ShowUndoRedoHistory(&ofsState.showHistory, LoadedFunscripts());
             simulator.ShowSimulator(&ofsState.showSimulator, ActiveFunscript(), player->CurrentTime(), overlayState.SplineMode);
 
             if (ShowMetadataEditor) {
@@ -1612,8 +1664,15 @@ void OpenFunscripter::Step() noexcept
 
             if (Status & OFS_GradientNeedsUpdate) {
                 Status &= ~(OFS_GradientNeedsUpdate);
+                heatmapChangedFrom = std::numeric_limits<float>::max();
+                heatmapChangedTo = std::numeric_limits<float>::lowest();
                 playerControls.UpdateHeatmap(player->Duration(), ActiveFunscript()->Actions());
             }
+            else if (heatmapChangedFrom <= heatmapChangedTo) {
+                playerControls.UpdateHeatmapRange(player->Duration(), ActiveFunscript()->Actions(), heatmapChangedFrom, heatmapChangedTo);
+                heatmapChangedFrom = std::numeric_limits<float>::max();
+                heatmapChangedTo = std::numeric_limits<float>::lowest();
+            }
 
             playerControls.DrawTimeline();
 
@@ -1722,6 +1781,7 @@ int OpenFunscripter::Run() noexcept
 
 void OpenFunscripter::Shutdown() noexcept
 {
+    finishAutoBackup(true);
     SaveState();
 
     OFS_DynFontAtlas::Shutdown();
@@ -1779,6 +1839,7 @@ void OpenFunscripter::openFile(const std::string& file) noexcept
         [this, file]() noexcept {
             auto filePath = Util::PathFromString(file);
             auto fileExtension = filePath.extension().u8string();
+            finishAutoBackup(true);
             LoadedProject = std::make_unique<OFS_Project>();
             OFS_StateManager::Get()->ClearProjectAll();
 
@@ -1885,6 +1946,7 @@ bool OpenFunscripter::closeProject(bool closeWithUnsavedChanges) noexcept
     }
     else {
         UpdateNewActiveScript(0);
+        finishAutoBackup(true);
         LoadedProject = std::make_unique<OFS_Project>();
         player->CloseVideo();
         playerControls.videoPreview->CloseVideo();
@@ -1987,9 +2049,12 @@ void OpenFunscripter::pasteSelection() noexcept
         currentTime - 0.0005f,
         currentTime + (CopiedSelection.back().atS - CopiedSelection.front().atS + 0.0005f));
 
+    FunscriptArray pasted;
+    pasted.reserve(CopiedSelection.size());
     for (auto&& action : CopiedSelection) {
-        ActiveFunscript()->AddAction(FunscriptAction(action.atS + offsetTime, action.pos));
+        pasted.emplace_back_unsorted(FunscriptAction(action.atS + offsetTime, action.pos));
     }
+    ActiveFunscript()->AddMultipleActions(pasted);
     float newPosTime = (CopiedSelection.end() - 1)->atS + offsetTime;
     player->SetPositionExact(newPosTime);
 }
@@ -2005,9 +2070,7 @@ void OpenFunscripter::pasteSelectionExact() noexcept
     }
 
     // paste without altering timestamps
-    for (auto&& action : CopiedSelection) {
-        ActiveFunscript()->AddAction(action);
-    }
+    ActiveFunscript()->AddMultipleActions(CopiedSelection);
 }
 
 void OpenFunscripter::equalizeSelection() noexcept
@@ -2087,20 +2150,15 @@ void OpenFunscripter::repeatLastStroke() noexcept
         undoSystem->Snapshot(StateType::REPEAT_STROKE, ActiveFunscript());
         auto action = ActiveFunscript()->GetActionAtTime(player->CurrentTime(), scripting->LogicalFrameTime());
         // if we are on top of an action we ignore the first action of the last stroke
-        if (action != nullptr) {
-            for (int i = stroke.size() - 2; i >= 0; i--) {
-                auto action = stroke[i];
-                action.atS += offsetTime;
-                ActiveFunscript()->AddAction(action);
-            }
-        }
-        else {
-            for (int i = stroke.size() - 1; i >= 0; i--) {
-                auto action = stroke[i];
-                action.atS += offsetTime;
-                ActiveFunscript()->AddAction(action);
-            }
+        int first = action != nullptr ? stroke.size() - 2 : stroke.size() - 1;
+        FunscriptArray repeated;
+        repeated.reserve(stroke.size());
+        for (int i = first; i >= 0; i--) {
+            auto action = stroke[i];
+            action.atS += offsetTime;
+            repeated.emplace_back_unsorted(action);
         }
+        ActiveFunscript()->AddMultipleActions(repeated);
         player->SetPositionExact(stroke.front().atS + offsetTime);
     }
 }
@@ -11,6 +11,7 @@
 #include "OFS_SpecialFunctions.h"
 #include "OFS_VideoplayerControls.h"
 #include "OFS_Project.h"
+#include "OFS_AutoBackup.h"
 #include "OFS_BlockingTask.h"
 #include "OFS_DynamicFontAtlas.h"
 #include "OFS_LuaExtensions.h"
@@ -25,6 +26,7 @@
 
 #include <memory>
 #include <chrono>
+#include <limits>
 
 enum OFS_Status : uint8_t {
     OFS_None = 0x0,
@@ -53,6 +55,13 @@ private:
 
     FunscriptArray CopiedSelection;
     std::chrono::steady_clock::time_point lastBackup;
+    // the auto backup which is currently written on a worker thread
+    std::unique_ptr<AutoBackupJob> backupJob;
+    std::string lastBackupPath;
+
+    // time range of the active script which changed since the last heatmap update
+    float heatmapChangedFrom = std::numeric_limits<float>::max();
+    float heatmapChangedTo = std::numeric_limits<float>::lowest();
 
     char tmpBuf[2][32];
 
@@ -63,6 +72,8 @@ private:
     void newFrame() noexcept;
     void render() noexcept;
     void autoBackup() noexcept;
+    // hands the result of the backup thread back to the project, wait blocks until it's done
+    void finishAutoBackup(bool wait) noexcept;
 
     void exitApp(bool force = false) noexcept;
 
@@ -114,8 +114,7 @@ bool OFS_ChapterManager::ExportClip(const Chapter& chapter, const std::string& o
         clippedScript.MoveSelectionTime(-chapter.startTime, 0.f);
 
         // FIXME: chapters and bookmarks are not included
-        auto funscriptJson = clippedScript.Serialize(projectState.metadata, false);
-        auto funscriptText = Util::SerializeJson(funscriptJson);
+        auto funscriptText = clippedScript.SerializeText(projectState.metadata, false);
         Util::WriteFile(scriptOutputPathStr.c_str(), funscriptText.data(), funscriptText.size());
     }
 
@@ -88,6 +88,17 @@ bool OFS_Preferences::ShowPreferenceWindow() noexcept
 					}
 					OFS::Tooltip(TR(VSYNC_TOOLTIP));
 					ImGui::Separator();
+					if (ImGui::InputInt(TR(UNDO_MEMORY_BUDGET), &state.undoMemoryBudgetMB, 16, 128)) {
+						state.undoMemoryBudgetMB = Util::Clamp(state.undoMemoryBudgetMB, 16, 16384);
+						save = true;
+					}
+					OFS::Tooltip(TR(UNDO_MEMORY_BUDGET_TOOLTIP));
+					ImGui::SameLine();
+					if (ImGui::Checkbox(TR(UNDO_SPILL_TO_DISK), &state.undoSpillToDisk)) {
+						save = true;
+					}
+					OFS::Tooltip(TR(UNDO_SPILL_TO_DISK_TOOLTIP));
+					ImGui::Separator();
 					ImGui::InputText(TR(FONT), state.fontOverride.empty() ? (char*)TR(DEFAULT_FONT) : (char*)state.fontOverride.c_str(),
 						state.fontOverride.size(), ImGuiInputTextFlags_ReadOnly);
 					ImGui::SameLine();
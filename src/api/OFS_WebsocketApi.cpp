@@ -2,10 +2,12 @@
 #include "OFS_WebsocketApiClient.h"
 #include "OFS_FileLogging.h"
 #include "OFS_EventSystem.h"
+#include "OFS_Profiling.h"
 
 #include "OpenFunscripter.h"
 #include "OFS_VideoplayerEvents.h"
 #include "OFS_WebsocketApiEvents.h"
+#include "OFS_WebsocketApiLoadTest.h"
 #include "state/WebsocketApiState.h"
 #include "state/states/ChapterState.h"
 
@@ -17,6 +19,11 @@
 #include "SDL_thread.h"
 #include "SDL_atomic.h"
 
+#include <cstring>
+#include <array>
+#include <algorithm>
+#include <type_traits>
+
 struct CivetwebContext
 {
     mg_context* web = nullptr;
@@ -30,14 +37,21 @@ static const char WS_URL[] = "/ofs";
 
 /* Define websocket sub-protocols. */
 /* This must be static data, available between mg_start and mg_stop. */
-static const char* subprotocols[] = {"ofs-api.json", NULL};
-static struct mg_websocket_subprotocols wsprot = {1, subprotocols};
+/* ofs-api.cbor has the same messages as ofs-api.json encoded as CBOR in binary frames. */
+static const char JSON_SUBPROTOCOL[] = "ofs-api.json";
+static const char CBOR_SUBPROTOCOL[] = "ofs-api.cbor";
+static const char* subprotocols[] = {JSON_SUBPROTOCOL, CBOR_SUBPROTOCOL, NULL};
+static struct mg_websocket_subprotocols wsprot = {2, subprotocols};
 
 /* Handler for new websocket connections. */
 static int ws_connect_handler(const struct mg_connection *conn, void *ctx) noexcept
 {
+	const struct mg_request_info *ri = mg_get_request_info(conn);
+	bool binary = ri->acceptedWebSocketSubprotocol != nullptr
+		&& strcmp(ri->acceptedWebSocketSubprotocol, CBOR_SUBPROTOCOL) == 0;
+
 	/* Allocate data for websocket client context, and initialize context. */
-    auto clientCtx = new OFS_WebsocketClient();
+    auto clientCtx = new OFS_WebsocketClient(binary);
 	if (!clientCtx) {
 		/* reject client */
 		return 1;
@@ -46,7 +60,6 @@ static int ws_connect_handler(const struct mg_connection *conn, void *ctx) noexc
 	mg_set_user_connection_data(conn, clientCtx);
 
 	/* DEBUG: New client connected (but not ready to receive data yet). */
-	const struct mg_request_info *ri = mg_get_request_info(conn);
 	LOGF_INFO("Client connected with subprotocol: %s\n",
 	       ri->acceptedWebSocketSubprotocol);
 
@@ -91,6 +104,7 @@ static int ws_data_handler(struct mg_connection *conn,
 		break;
 	case MG_WEBSOCKET_OPCODE_BINARY:
 		messageType = "binary";
+		clientCtx->ReceiveBinary(data, datasize);
 		break;
 	case MG_WEBSOCKET_OPCODE_CONNECTION_CLOSE:
 		messageType = "conn_close";
@@ -123,30 +137,85 @@ static void ws_close_handler(const struct mg_connection *conn, void *ctx) noexce
     delete clientCtx;
 }
 
+// every alternative except std::monostate
+inline static ToJsonInterface* toJsonInterface(WsEvent& event) noexcept
+{
+	return std::visit([](auto& ev) noexcept -> ToJsonInterface*
+	{
+		if constexpr (std::is_base_of_v<ToJsonInterface, std::decay_t<decltype(ev)>>) return &ev;
+		else return nullptr;
+	}, event);
+}
+
+// clients only care about the latest of these, older ones in the same batch are dropped
+// events for a single client are never dropped
+inline static bool isLatestWins(WsEvent& event) noexcept
+{
+	auto toJson = toJsonInterface(event);
+	if(!toJson || toJson->target.mode != WsTarget::AllClients) return false;
+	return std::holds_alternative<WsTimeChange>(event)
+		|| std::holds_alternative<WsPlayChange>(event)
+		|| std::holds_alternative<WsPlaybackSpeedChange>(event)
+		|| std::holds_alternative<WsDurationChange>(event)
+		|| std::holds_alternative<WsMediaChange>(event);
+}
+
 static int EventSerializationThread(void* user) noexcept
 {
 	auto ctx = static_cast<EventSerializationContext*>(user);
-	auto waitMut = SDL_CreateMutex();
-	SDL_LockMutex(waitMut);
+	// reused for every batch so the events are swapped out without allocating
+	std::vector<EventSerializationContext::QueuedEvent> batch;
+	batch.reserve(EventSerializationContext::QueueCapacity);
+	std::array<size_t, std::variant_size_v<WsEvent>> lastOfType;
+	const double msPerTick = 1000.0 / (double)SDL_GetPerformanceFrequency();
+
 	while(!ctx->shouldExit)
 	{
-		if(SDL_CondWait(ctx->processCond, waitMut) == 0)
+		if(SDL_SemWait(ctx->processSem) != 0) continue;
+		batch.clear();
+		if(ctx->events.pop_all(batch) == 0) continue;
+
+		lastOfType.fill(batch.size());
+		for(size_t i=0; i < batch.size(); i += 1)
 		{
-			SDL_AtomicLock(&ctx->eventLock);
-			for(auto& ev : ctx->events)
+			if(isLatestWins(batch[i].event)) lastOfType[batch[i].event.index()] = i;
+		}
+
+		// only serialize what the connected clients can read
+		bool textClients = OFS_WebsocketClient::TextClients() > 0;
+		bool binaryClients = OFS_WebsocketClient::BinaryClients() > 0;
+		uint32_t coalesced = 0;
+		uint64_t maxLatency = 0;
+		for(size_t i=0; i < batch.size(); i += 1)
+		{
+			auto& queued = batch[i];
+			bool latestWins = isLatestWins(queued.event);
+			if(latestWins && lastOfType[queued.event.index()] != i)
 			{
-				auto toJson = dynamic_cast<ToJsonInterface*>(ev.get());
-				nlohmann::json json;
-				toJson->Serialize(json);
-				auto jsonText = Util::SerializeJson(json);
-				EV::Queue().directDispatch(WsSerializedEvent::EventType, 
-					std::move(EV::Make<WsSerializedEvent>(std::move(jsonText))));
+				coalesced += 1;
+				continue;
 			}
-			ctx->events.clear();
-			SDL_AtomicUnlock(&ctx->eventLock);
+
+			auto toJson = toJsonInterface(queued.event);
+			if(!toJson) continue;
+
+			std::string jsonText;
+			std::vector<uint8_t> cbor;
+			if(textClients) toJson->SerializeText(jsonText);
+			if(binaryClients) toJson->SerializeCBOR(cbor);
+			// a missed play/speed/media/duration change needs a resync, a missed time change doesn't
+			bool evictable = latestWins && std::holds_alternative<WsTimeChange>(queued.event);
+			EV::Queue().directDispatch(WsSerializedEvent::EventType, 
+				std::move(EV::Make<WsSerializedEvent>(std::move(jsonText), std::move(cbor), toJson->target,
+					latestWins ? (uint32_t)queued.event.index() : 0, evictable)));
+			maxLatency = std::max(maxLatency, SDL_GetPerformanceCounter() - queued.queuedAt);
 		}
+
+		float latencyMs = (float)(maxLatency * msPerTick);
+		ctx->lastLatencyMs = latencyMs;
+		ctx->averageLatencyMs = ctx->averageLatencyMs * 0.9f + latencyMs * 0.1f;
+		ctx->coalescedEvents.fetch_add(coalesced, std::memory_order_relaxed);
 	}
-	SDL_DestroyMutex(waitMut);
 	ctx->hasExited = true;
 	return 0;
 }
@@ -173,6 +242,10 @@ OFS_WebsocketApi::OFS_WebsocketApi() noexcept
 	EV::Queue().appendListener(DurationChangeEvent::EventType, DurationChangeEvent::HandleEvent(
 		[this](const DurationChangeEvent* ev) noexcept
 		{
+			if(ev->playerType == VideoplayerType::Main)
+			{
+				OFS_WebsocketClient::CommandBuffer.SetMediaDuration(ev->duration);
+			}
 			if(ClientsConnected() > 0 && ev->playerType == VideoplayerType::Main)
 			{
 				eventSerializationCtx->Push<WsDurationChange>(ev->duration);
@@ -213,6 +286,10 @@ OFS_WebsocketApi::OFS_WebsocketApi() noexcept
 	EV::Queue().appendListener(ProjectLoadedEvent::EventType, ProjectLoadedEvent::HandleEvent(
 		[this](const ProjectLoadedEvent* ev) noexcept
 		{
+			// clients get the new scripts with a fresh revision
+			scriptUpdates.clear();
+			scriptSyncs.clear();
+			OFS_WebsocketClient::CommandBuffer.ClearSnapshots();
 			if(ClientsConnected() > 0) 
 			{
 				// WsProjectChange remains handled by each internal client 
@@ -230,8 +307,18 @@ OFS_WebsocketApi::OFS_WebsocketApi() noexcept
 				// Funscript name changes are handled as the old name being removed and the new one added
 				auto app = OpenFunscripter::ptr;
 				auto& projectState = app->LoadedProject->State();
+				auto it = std::find_if(app->LoadedFunscripts().begin(), app->LoadedFunscripts().end(), 
+					[Script = ev->Script](auto& script) noexcept { return script.get() == Script; });
+				if(it == app->LoadedFunscripts().end()) return;
+
+				// with the actions the clients already have, changes since then still follow as usual
+				auto& sync = sentScript(*it);
+				OFS_WebsocketClient::CommandBuffer.RemoveSnapshot(ev->oldName);
+				OFS_WebsocketClient::CommandBuffer.PublishSnapshot((*it)->Title(), sync.sent);
+				Funscript::FunscriptData data;
+				data.Actions = sync.sent->actions;
 				eventSerializationCtx->Push<WsFunscriptRemove>(ev->oldName);
-				eventSerializationCtx->Push<WsFunscriptChange>(ev->Script->Title(), ev->Script->Data(), projectState.metadata);
+				eventSerializationCtx->Push<WsFunscriptChange>((*it)->Title(), std::move(data), projectState.metadata, sync.sent->revision);
 			}
 		}
 	));
@@ -243,11 +330,7 @@ OFS_WebsocketApi::OFS_WebsocketApi() noexcept
 				auto app = OpenFunscripter::ptr;				
 				for(int i=0, size=app->LoadedFunscripts().size(); i < size; i += 1)
 				{
-					auto scriptIdx = i;
-					if(scriptIdx + 1 > this->scriptUpdateCooldown.size()) {
-						scriptUpdateCooldown.resize(scriptIdx + 1, 0);
-					}
-					scriptUpdateCooldown[scriptIdx] = SDL_GetTicks();
+					touchScript(i, true);
 				}
 			}
 		));
@@ -259,11 +342,7 @@ OFS_WebsocketApi::OFS_WebsocketApi() noexcept
 				auto app = OpenFunscripter::ptr;				
 				for(int i=0, size=app->LoadedFunscripts().size(); i < size; i += 1)
 				{
-					auto scriptIdx = i;
-					if(scriptIdx + 1 > this->scriptUpdateCooldown.size()) {
-						scriptUpdateCooldown.resize(scriptIdx + 1, 0);
-					}
-					scriptUpdateCooldown[scriptIdx] = SDL_GetTicks();
+					touchScript(i, true);
 				}
 			}
 		));
@@ -271,6 +350,7 @@ OFS_WebsocketApi::OFS_WebsocketApi() noexcept
 	EV::Queue().appendListener(FunscriptRemovedEvent::EventType, FunscriptRemovedEvent::HandleEvent(
 		[this](const FunscriptRemovedEvent* ev) noexcept
 		{
+			OFS_WebsocketClient::CommandBuffer.RemoveSnapshot(ev->name);
 			if(ClientsConnected() > 0)
 			{
 				eventSerializationCtx->Push<WsFunscriptRemove>(ev->name);
@@ -290,16 +370,144 @@ OFS_WebsocketApi::OFS_WebsocketApi() noexcept
 				if(it != app->LoadedFunscripts().end())
 				{
 					auto scriptIdx = std::distance(app->LoadedFunscripts().begin(), it);
-					if(scriptIdx + 1 > this->scriptUpdateCooldown.size()) {
-						scriptUpdateCooldown.resize(scriptIdx + 1, 0);
-					}
-					scriptUpdateCooldown[scriptIdx] = SDL_GetTicks();
+					touchScript(scriptIdx, false);
 				}
 			}
 		}
 	));
 }
 
+void OFS_WebsocketApi::touchScript(size_t scriptIdx, bool metadataChanged) noexcept
+{
+	if(scriptIdx + 1 > scriptUpdates.size()) {
+		scriptUpdates.resize(scriptIdx + 1);
+	}
+	auto& update = scriptUpdates[scriptIdx];
+	update.cooldown = SDL_GetTicks();
+	update.metadataChanged = update.metadataChanged || metadataChanged;
+}
+
+OFS_WebsocketApi::ScriptSync& OFS_WebsocketApi::syncFor(const std::shared_ptr<Funscript>& script) noexcept
+{
+	scriptSyncs.erase(std::remove_if(scriptSyncs.begin(), scriptSyncs.end(),
+		[](auto& sync) noexcept { return sync.script.expired(); }), scriptSyncs.end());
+	auto it = std::find_if(scriptSyncs.begin(), scriptSyncs.end(), 
+		[&script](auto& sync) noexcept { return sync.script.lock() == script; });
+	if(it != scriptSyncs.end()) return *it;
+
+	// revision 0 means no client has the script yet
+	auto& sync = scriptSyncs.emplace_back();
+	sync.script = script;
+	return sync;
+}
+
+OFS_WebsocketApi::ScriptSync& OFS_WebsocketApi::sentScript(const std::shared_ptr<Funscript>& script) noexcept
+{
+	auto& sync = syncFor(script);
+	if(!sync.sent)
+	{
+		// nothing was sent yet, from now on this is what clients have
+		setSent(sync, script, 1);
+	}
+	return sync;
+}
+
+void OFS_WebsocketApi::setSent(ScriptSync& sync, const std::shared_ptr<Funscript>& script, uint32_t revision) noexcept
+{
+	sync.sent = std::make_shared<const WsScriptSnapshot>(revision, script->Data().Actions);
+	OFS_WebsocketClient::CommandBuffer.PublishSnapshot(script->Title(), sync.sent);
+}
+
+void OFS_WebsocketApi::pushScriptUpdate(const std::shared_ptr<Funscript>& script, bool metadataChanged) noexcept
+{
+	OFS_PROFILE(__FUNCTION__);
+	auto app = OpenFunscripter::ptr;
+	auto& projectState = app->LoadedProject->State();
+	auto& actions = script->Data().Actions;
+	auto& sync = syncFor(script);
+
+	std::vector<WsFunscriptDelta::Hunk> hunks;
+	bool deltaCheaper = sync.sent
+		? WsFunscriptDelta::Compute(sync.sent->actions, actions, hunks)
+		: WsFunscriptDelta::Compute(FunscriptArray(), actions, hunks);
+	bool changed = metadataChanged || !hunks.empty();
+	uint32_t baseRevision = sync.sent ? sync.sent->revision : 0;
+	if(changed)
+	{
+		setSent(sync, script, baseRevision + 1);
+	}
+	uint32_t revision = sync.sent ? sync.sent->revision : 0;
+
+	int deltaClients = OFS_WebsocketClient::DeltaClients();
+	if(ClientsConnected() > deltaClients)
+	{
+		// these always got the whole script, even if nothing changed
+		WsFunscriptChange ev(script->Title(), script->Data(), projectState.metadata, revision);
+		ev.target.mode = WsTarget::FullUpdateClients;
+		eventSerializationCtx->Push(std::move(ev));
+	}
+
+	if(deltaClients > 0 && changed)
+	{
+		if(metadataChanged || !deltaCheaper || baseRevision == 0)
+		{
+			WsFunscriptChange ev(script->Title(), script->Data(), projectState.metadata, revision);
+			ev.target.mode = WsTarget::DeltaUpdateClients;
+			eventSerializationCtx->Push(std::move(ev));
+		}
+		else
+		{
+			WsFunscriptDelta ev(script->Title(), baseRevision, revision, std::move(hunks));
+			ev.target.mode = WsTarget::DeltaUpdateClients;
+			eventSerializationCtx->Push(std::move(ev));
+		}
+	}
+}
+
+void OFS_WebsocketApi::ResyncScripts(uint32_t clientId, const std::string& name) noexcept
+{
+	OFS_PROFILE(__FUNCTION__);
+	auto app = OpenFunscripter::ptr;
+	auto& projectState = app->LoadedProject->State();
+	for(auto& script : app->LoadedFunscripts())
+	{
+		if(!name.empty() && script->Title() != name) continue;
+
+		auto& sync = sentScript(script);
+		// pending changes arrive as a delta on top of this revision
+		Funscript::FunscriptData data;
+		data.Actions = sync.sent->actions;
+		WsFunscriptChange ev(script->Title(), std::move(data), projectState.metadata, sync.sent->revision);
+		ev.target.mode = WsTarget::SingleClient;
+		ev.target.clientId = clientId;
+		eventSerializationCtx->Push(std::move(ev));
+	}
+}
+
+void OFS_WebsocketApi::ResyncClient(uint32_t clientId) noexcept
+{
+	OFS_PROFILE(__FUNCTION__);
+	auto app = OpenFunscripter::ptr;
+	WsTarget target;
+	target.mode = WsTarget::SingleClient;
+	target.clientId = clientId;
+	auto pushTargeted = [this, target](auto&& event) noexcept
+	{
+		event.target = target;
+		eventSerializationCtx->Push(std::move(event));
+	};
+	pushTargeted(WsMediaChange(app->player->VideoPath()));
+	pushTargeted(WsPlaybackSpeedChange(app->player->CurrentSpeed()));
+	pushTargeted(WsPlayChange(!app->player->IsPaused()));
+	pushTargeted(WsDurationChange(app->player->Duration()));
+	ResyncScripts(clientId, std::string());
+	// lets the client request another resync if it falls behind again
+	target.resyncEnd = true;
+	WsTimeChange timeChange(app->player->CurrentPlayerTime());
+	timeChange.target = target;
+	eventSerializationCtx->Push(std::move(timeChange));
+}
+
 int OFS_WebsocketApi::ClientsConnected() const noexcept
 {
 	return SDL_AtomicGet(&CTX->clientsConnected);
@@ -312,6 +520,8 @@ bool OFS_WebsocketApi::Init() noexcept
     if(mg_init_library(0) != 0)
         return false;
 
+	OFS_WebsocketClient::Clock.Start();
+
 	auto& state = WebsocketApiState::State(stateHandle);
 	if(state.serverActive) StartServer();
 
@@ -355,6 +565,9 @@ bool OFS_WebsocketApi::StartServer() noexcept
 
 void OFS_WebsocketApi::StopServer() noexcept
 {
+#ifndef NDEBUG
+	if(loadTest) loadTest->Stop();
+#endif
 	if(CTX->web)
 	{
 		mg_stop(CTX->web);
@@ -364,23 +577,32 @@ void OFS_WebsocketApi::StopServer() noexcept
 
 void OFS_WebsocketApi::Update() noexcept
 {
-	if(ClientsConnected() <= 0) return;
+	// the player only updates its position once per frame
+	OFS_WebsocketClient::Clock.Publish(OpenFunscripter::ptr->player->Clock());
+	if(ClientsConnected() <= 0) 
+	{
+		// changes aren't tracked without clients, the next one starts at the current scripts
+		if(!scriptSyncs.empty())
+		{
+			scriptSyncs.clear();
+			OFS_WebsocketClient::CommandBuffer.ClearSnapshots();
+		}
+		return;
+	}
 
-	for(int i=0, size=scriptUpdateCooldown.size(); i < size; i += 1)
+	for(int i=0, size=scriptUpdates.size(); i < size; i += 1)
 	{
-		auto& cd = scriptUpdateCooldown[i];
-		if(cd == 0) continue;
-		if(SDL_GetTicks() - cd >= 200)
+		auto& update = scriptUpdates[i];
+		if(update.cooldown == 0) continue;
+		if(SDL_GetTicks() - update.cooldown >= 200)
 		{
 			auto app = OpenFunscripter::ptr;
 			if(i >= 0 && i < app->LoadedFunscripts().size())
 			{
-				auto& projectState = app->LoadedProject->State();
-				auto& script = app->LoadedFunscripts()[i];
-				eventSerializationCtx->Push<WsFunscriptChange>(script->Title(), script->Data(), projectState.metadata);
+				pushScriptUpdate(app->LoadedFunscripts()[i], update.metadataChanged);
 				LOGF_DEBUG("[WsFunscriptChange]: ScriptIdx: %d", i);
 			}
-			cd = 0;
+			update = ScriptUpdate();
 		}
 	}
 
@@ -392,9 +614,17 @@ void OFS_WebsocketApi::Update() noexcept
 	OFS_WebsocketClient::CommandBuffer.ProcessCommands();
 }
 
+OFS_WebsocketApi::~OFS_WebsocketApi() noexcept
+{
+}
+
 void OFS_WebsocketApi::Shutdown() noexcept
 {
+#ifndef NDEBUG
+	loadTest.reset();
+#endif
 	eventSerializationCtx->Shutdown();
+	OFS_WebsocketClient::Clock.Stop();
 	StopServer();
     mg_exit_library();
     delete CTX;
@@ -423,6 +653,19 @@ void OFS_WebsocketApi::ShowWindow(bool* open) noexcept
 		ImGui::TextColored(ImVec4(0.f, 1.f, 0.f, 1.f), "ws://0.0.0.0:%d%s", ports.port, WS_URL);
 		auto clientCount = ClientsConnected();
 		ImGui::Text("%s: %d", TR(CLIENT_COUNT), clientCount);
+
+		auto& events = *eventSerializationCtx;
+		ImGui::Text("%s: %d/%d", TR(EVENT_QUEUE), (int)events.events.size(), (int)events.events.capacity());
+		ImGui::Text("%s: %.2f ms (%.2f ms)", TR(EVENT_LATENCY), events.averageLatencyMs.load(), events.lastLatencyMs.load());
+		ImGui::Text("%s: %u %s: %u", TR(COALESCED_EVENTS), events.coalescedEvents.load(), TR(DROPPED_EVENTS), events.droppedEvents.load());
+
+#ifndef NDEBUG
+		if(ImGui::CollapsingHeader("Load test"))
+		{
+			if(!loadTest) loadTest = std::make_unique<OFS_WebsocketLoadTest>();
+			loadTest->ShowControls(ports.port, WS_URL);
+		}
+#endif
 	}
 
 	auto textChanged = ImGui::InputText(TR(PORT), &state.port, ImGuiInputTextFlags_CallbackCharFilter | ImGuiInputTextFlags_CharsDecimal,
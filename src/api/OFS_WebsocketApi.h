@@ -4,71 +4,128 @@
 #include <vector>
 #include <memory>
 #include <vector>
+#include <string>
 #include <atomic>
+#include <variant>
 
 #include "SDL_thread.h"
 #include "SDL_atomic.h"
 #include "SDL_timer.h"
+#include "SDL_mutex.h"
 
 #include "OFS_Event.h"
+#include "OFS_MPSCQueue.h"
+#include "OFS_WebsocketApiEvents.h"
+#include "OFS_WebsocketApiCommands.h"
+#include "Funscript.h"
+
+// Every event the serialization thread turns into text/CBOR.
+// Stored by value so queuing an event doesn't allocate.
+using WsEvent = std::variant<std::monostate, WsMediaChange, WsPlaybackSpeedChange, WsPlayChange, WsTimeChange,
+    WsDurationChange, WsFunscriptChange, WsFunscriptRemove, WsFunscriptDelta>;
 
 struct EventSerializationContext
 {
-    SDL_cond* processCond = nullptr;
+    struct QueuedEvent
+    {
+        WsEvent event;
+        uint64_t queuedAt = 0; // SDL_GetPerformanceCounter
+    };
+    static constexpr size_t QueueCapacity = 512;
+
+    SDL_sem* processSem = nullptr;
     
     std::atomic<bool> shouldExit = false;
     std::atomic<bool> hasExited = false;
 
-    SDL_SpinLock eventLock = {0};
-    std::vector<EventPointer> events;
+    mpsc_queue<QueuedEvent, QueueCapacity> events;
+
+    // written by the serialization thread, shown in the api window
+    std::atomic<float> lastLatencyMs = 0.f; // longest time from Push until sent in the last batch
+    std::atomic<float> averageLatencyMs = 0.f;
+    std::atomic<uint32_t> coalescedEvents = 0;
+    std::atomic<uint32_t> droppedEvents = 0;
 
     EventSerializationContext() noexcept
     {
-        processCond = SDL_CreateCond();
+        processSem = SDL_CreateSemaphore(0);
     }
 
     template<typename T, typename... Args>
     inline void Push(Args&&... args) noexcept
     {
-        SDL_AtomicLock(&eventLock);
-        events.emplace_back(std::move(std::make_shared<T>(std::forward<Args>(args)...)));
-        SDL_AtomicUnlock(&eventLock);
+        Push(WsEvent(std::in_place_type<T>, std::forward<Args>(args)...));
     }
 
-    inline bool EventsEmpty() noexcept
+    inline void Push(WsEvent&& event) noexcept
     {
-        SDL_AtomicLock(&eventLock);
-        bool empty = events.empty();
-        SDL_AtomicUnlock(&eventLock);
-        return empty;
+        QueuedEvent queued{ std::move(event), SDL_GetPerformanceCounter() };
+        if(!events.try_push(std::move(queued)))
+        {
+            // only happens if the serialization thread is stuck
+            droppedEvents.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    inline bool EventsEmpty() const noexcept
+    {
+        return events.empty();
     }
 
     inline int StartProcessing() noexcept
     {
-        return SDL_CondSignal(processCond);
+        if(SDL_SemValue(processSem) > 0) return 0;
+        return SDL_SemPost(processSem);
     }
 
     inline void Shutdown() noexcept
     {
         shouldExit = true;
-        StartProcessing();
+        SDL_SemPost(processSem);
         while(!hasExited) { 
             SDL_Delay(1); 
         }
-        SDL_DestroyCond(processCond);
+        SDL_DestroySemaphore(processSem);
     }
 };
 
 class OFS_WebsocketApi
 {
     private:
+    struct ScriptUpdate
+    {
+        uint32_t cooldown = 0;
+        bool metadataChanged = false;
+    };
+
+    // What the clients have of a script, used to compute funscript_delta.
+    // The same snapshot answers queries, see WsCommandBuffer::RunQuery.
+    struct ScriptSync
+    {
+        std::weak_ptr<Funscript> script;
+        // nullptr until the script was sent
+        std::shared_ptr<const WsScriptSnapshot> sent;
+    };
+
     void* ctx = nullptr;
     uint32_t stateHandle = 0xFFFF'FFFF;
-    std::vector<uint32_t> scriptUpdateCooldown;
+    std::vector<ScriptUpdate> scriptUpdates;
+    std::vector<ScriptSync> scriptSyncs;
     std::unique_ptr<EventSerializationContext> eventSerializationCtx;
+#ifndef NDEBUG
+    std::unique_ptr<class OFS_WebsocketLoadTest> loadTest;
+#endif
+
+    void touchScript(size_t scriptIdx, bool metadataChanged) noexcept;
+    ScriptSync& syncFor(const std::shared_ptr<Funscript>& script) noexcept;
+    // like syncFor but starts at the current actions if nothing was sent yet
+    ScriptSync& sentScript(const std::shared_ptr<Funscript>& script) noexcept;
+    void setSent(ScriptSync& sync, const std::shared_ptr<Funscript>& script, uint32_t revision) noexcept;
+    void pushScriptUpdate(const std::shared_ptr<Funscript>& script, bool metadataChanged) noexcept;
 
     public:
     OFS_WebsocketApi() noexcept;
+    ~OFS_WebsocketApi() noexcept;
     OFS_WebsocketApi(const OFS_WebsocketApi&) = delete;
     OFS_WebsocketApi(OFS_WebsocketApi&&) = delete;
 
@@ -82,4 +139,8 @@ class OFS_WebsocketApi
     void Shutdown() noexcept;
 
     int ClientsConnected() const noexcept;
+    // sends the scripts as clients last received them, all scripts if name is empty
+    void ResyncScripts(uint32_t clientId, const std::string& name) noexcept;
+    // sends the player state and all scripts
+    void ResyncClient(uint32_t clientId) noexcept;
 };
\ No newline at end of file
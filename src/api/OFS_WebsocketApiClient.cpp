@@ -10,17 +10,59 @@
 #include "civetweb.h"
 #include "OpenFunscripter.h"
 
+#include <algorithm>
+#include <cmath>
+
+// validates without building a DOM, fails as soon as arrays/objects nest deeper than maxDepth
+class CborDepthLimit : public nlohmann::json_sax<nlohmann::json>
+{
+    private:
+    uint32_t depth = 0;
+    uint32_t maxDepth;
+
+    public:
+    explicit CborDepthLimit(uint32_t maxDepth) noexcept : maxDepth(maxDepth) {}
+
+    bool null() override { return true; }
+    bool boolean(bool) override { return true; }
+    bool number_integer(number_integer_t) override { return true; }
+    bool number_unsigned(number_unsigned_t) override { return true; }
+    bool number_float(number_float_t, const string_t&) override { return true; }
+    bool string(string_t&) override { return true; }
+    bool binary(binary_t&) override { return true; }
+    bool key(string_t&) override { return true; }
+    bool start_object(std::size_t) override { return ++depth <= maxDepth; }
+    bool end_object() override { depth -= 1; return true; }
+    bool start_array(std::size_t) override { return ++depth <= maxDepth; }
+    bool end_array() override { depth -= 1; return true; }
+    bool parse_error(std::size_t, const std::string&, const nlohmann::detail::exception&) override { return false; }
+};
+
 WsCommandBuffer OFS_WebsocketClient::CommandBuffer = WsCommandBuffer();
+OFS_WebsocketClock OFS_WebsocketClient::Clock;
+SDL_atomic_t OFS_WebsocketClient::nextClientId = {0};
+SDL_atomic_t OFS_WebsocketClient::deltaClientCount = {0};
+SDL_atomic_t OFS_WebsocketClient::textClientCount = {0};
+SDL_atomic_t OFS_WebsocketClient::binaryClientCount = {0};
 
-OFS_WebsocketClient::OFS_WebsocketClient() noexcept
+OFS_WebsocketClient::OFS_WebsocketClient(bool binary) noexcept
+    : binary(binary)
 {
     LOG_DEBUG("Created new websocket client.");
+    id = SDL_AtomicAdd(&nextClientId, 1) + 1;
+    SDL_AtomicIncRef(binary ? &binaryClientCount : &textClientCount);
+    queueMut = SDL_CreateMutex();
+    queueCond = SDL_CreateCond();
+
     std::vector<UnsubscribeFn> eventUnsubs;
     eventUnsubs.emplace_back(
         EV::MakeUnsubscibeFn(WsSerializedEvent::EventType, 
-            EV::Queue().appendListener(WsSerializedEvent::EventType, WsSerializedEvent::HandleEvent(
-                EVENT_SYSTEM_BIND(this, &OFS_WebsocketClient::handleSerializedEvent)
-            ))
+            EV::Queue().appendListener(WsSerializedEvent::EventType, 
+                [this](const EventPointer& ev) noexcept
+                {
+                    // the event is shared by all clients and stays alive while it's queued
+                    handleSerializedEvent(std::static_pointer_cast<const WsSerializedEvent>(ev));
+                })
         )
     );
 
@@ -44,23 +86,166 @@ OFS_WebsocketClient::~OFS_WebsocketClient() noexcept
 {
     LOG_DEBUG("Destroying websocket client.");
     eventUnsub();   
+    Clock.Unsubscribe(this);
+    connected = false;
+    SDL_LockMutex(queueMut);
+    stopWriter = true;
+    SDL_CondSignal(queueCond);
+    SDL_UnlockMutex(queueMut);
+    if(writerThread) SDL_WaitThread(writerThread, nullptr);
+    SDL_DestroyCond(queueCond);
+    SDL_DestroyMutex(queueMut);
+
+    if(deltaUpdates) SDL_AtomicAdd(&deltaClientCount, -1);
+    SDL_AtomicDecRef(binary ? &binaryClientCount : &textClientCount);
+}
+
+size_t OFS_WebsocketClient::payloadSize(const WsSerializedEvent& msg) const noexcept
+{
+    return binary ? msg.serializedCBOR.size() : msg.serializedEvent.size();
+}
+
+int OFS_WebsocketClient::writerLoop(void* user) noexcept
+{
+    auto client = static_cast<OFS_WebsocketClient*>(user);
+    SDL_LockMutex(client->queueMut);
+    for(;;)
+    {
+        while(client->sendQueue.empty() && !client->stopWriter) {
+            SDL_CondWait(client->queueCond, client->queueMut);
+        }
+        if(client->stopWriter) break;
+
+        auto msg = std::move(client->sendQueue.front());
+        client->sendQueue.pop_front();
+        client->queuedBytes -= client->payloadSize(*msg);
+        SDL_UnlockMutex(client->queueMut);
+
+        // this is the only place writing to the connection
+        // a slow client blocks here without holding up anyone else
+        int result = client->binary
+            ? mg_websocket_write(client->conn, MG_WEBSOCKET_OPCODE_BINARY, (const char*)msg->serializedCBOR.data(), msg->serializedCBOR.size())
+            : mg_websocket_write(client->conn, MG_WEBSOCKET_OPCODE_TEXT, msg->serializedEvent.data(), msg->serializedEvent.size());
+        if(result < 0)
+        {
+            LOG_ERROR("Failed to send websocket message.");
+        }
+        msg.reset();
+        SDL_LockMutex(client->queueMut);
+    }
+    SDL_UnlockMutex(client->queueMut);
+    return 0;
 }
 
-void OFS_WebsocketClient::sendMessage(const std::string& msg) noexcept
+void OFS_WebsocketClient::sendMessage(std::shared_ptr<const WsSerializedEvent>&& msg) noexcept
 {
     OFS_PROFILE(__FUNCTION__);
-    if(conn == nullptr) return;
-    if(mg_websocket_write(conn, MG_WEBSOCKET_OPCODE_TEXT, msg.data(), msg.size()) < 0)
+    if(!connected) return;
+    size_t size = payloadSize(*msg);
+    bool overflow = false;
+
+    SDL_LockMutex(queueMut);
+    if(msg->coalesceKey != 0)
+    {
+        // the writer didn't get to the previous one yet, only the newer one is sent
+        auto it = std::find_if(sendQueue.begin(), sendQueue.end(),
+            [key = msg->coalesceKey](auto& queued) noexcept { return queued->coalesceKey == key; });
+        if(it != sendQueue.end())
+        {
+            queuedBytes -= payloadSize(**it);
+            sendQueue.erase(it);
+        }
+    }
+
+    while(!sendQueue.empty() && (sendQueue.size() >= MaxQueuedMessages || queuedBytes + size > MaxQueuedBytes))
+    {
+        // time updates & clock samples go first
+        auto it = std::find_if(sendQueue.begin(), sendQueue.end(),
+            [](auto& queued) noexcept { return queued->evictable; });
+        if(it == sendQueue.end())
+        {
+            // everything left matters, drop the backlog and start over with a resync
+            droppedMessages += (uint32_t)sendQueue.size();
+            sendQueue.clear();
+            queuedBytes = 0;
+            overflow = true;
+            break;
+        }
+        queuedBytes -= payloadSize(**it);
+        sendQueue.erase(it);
+        droppedMessages += 1;
+    }
+
+    if(overflow && resyncPending)
+    {
+        // part of the resync in flight is gone, requesting another one now would overflow the same way
+        if(!overflowedDuringResync) droppedResyncs += 1;
+        overflowedDuringResync = true;
+        overflow = false;
+    }
+    else if(overflow)
+    {
+        resyncPending = true;
+    }
+    if(msg->target.resyncEnd && msg->target.mode == WsTarget::SingleClient)
+    {
+        // resyncPending stays set if another one is needed
+        overflow = overflowedDuringResync;
+        resyncPending = overflowedDuringResync;
+        overflowedDuringResync = false;
+    }
+
+    queuedBytes += size;
+    sendQueue.emplace_back(std::move(msg));
+    SDL_CondSignal(queueCond);
+    SDL_UnlockMutex(queueMut);
+
+    if(overflow)
     {
-        LOG_ERROR("Failed to send websocket message.");
+        LOGF_WARN("Websocket client %u can't keep up, resyncing. (%u messages & %u resyncs dropped)",
+            id, droppedMessages.load(), droppedResyncs.load());
+        requestResync();
     }
 }
 
-void OFS_WebsocketClient::handleSerializedEvent(const WsSerializedEvent* ev) noexcept
+void OFS_WebsocketClient::requestResync() noexcept
+{
+    // resyncPending is already set
+    if(!CommandBuffer.AddCmd(WsClientResyncCmd(id)))
+    {
+        SDL_LockMutex(queueMut);
+        resyncPending = false;
+        SDL_UnlockMutex(queueMut);
+    }
+}
+
+void OFS_WebsocketClient::sendJson(const nlohmann::json& json) noexcept
+{
+    if(binary) sendMessage(EV::MakeTyped<WsSerializedEvent>(std::string(), Util::SerializeCBOR(json), WsTarget()));
+    else sendMessage(EV::MakeTyped<WsSerializedEvent>(Util::SerializeJson(json), std::vector<uint8_t>(), WsTarget()));
+}
+
+void OFS_WebsocketClient::handleSerializedEvent(const std::shared_ptr<const WsSerializedEvent>& ev) noexcept
 {
     // NOTE: this is not called by the main thread
     OFS_PROFILE(__FUNCTION__);
-    sendMessage(ev->serializedEvent);
+    switch(ev->target.mode)
+    {
+        case WsTarget::FullUpdateClients:
+            if(deltaUpdates) return;
+            break;
+        case WsTarget::DeltaUpdateClients:
+            if(!deltaUpdates) return;
+            break;
+        case WsTarget::SingleClient:
+            if(ev->target.clientId != id) return;
+            break;
+        default:
+            break;
+    }
+    // empty if the client connected after the event was serialized
+    if(payloadSize(*ev) == 0) return;
+    sendMessage(std::shared_ptr<const WsSerializedEvent>(ev));
 }
 
 void OFS_WebsocketClient::handleProjectChange(const WsProjectChange* ev) noexcept
@@ -72,51 +257,104 @@ void OFS_WebsocketClient::handleProjectChange(const WsProjectChange* ev) noexcep
 void OFS_WebsocketClient::UpdateAll() noexcept
 {
     // Update everything
-    auto app = OpenFunscripter::ptr;
+    nlohmann::json projectChange = WsProjectChange();
+    sendJson(projectChange);
 
-    auto serializeSend = [this](auto&& event) noexcept
-    {
-        nlohmann::json json = event;
-        auto jsonText = Util::SerializeJson(json);
-        sendMessage(jsonText);
-    };
-
-    serializeSend(std::move(WsProjectChange()));
-    serializeSend(std::move(WsMediaChange(app->player->VideoPath())));
-    serializeSend(std::move(WsPlaybackSpeedChange(app->player->CurrentSpeed())));
-    serializeSend(std::move(WsPlayChange(!app->player->IsPaused())));
-    serializeSend(std::move(WsDurationChange(app->player->Duration())));
-    serializeSend(std::move(WsTimeChange(app->player->CurrentPlayerTime())));
-
-    auto& projectState = app->LoadedProject->State();
-    for(auto& script : app->LoadedFunscripts())
-    {
-        serializeSend(std::move(WsFunscriptChange(script->Title(), script->Data(), projectState.metadata)));
-    }
+    // the player state & scripts are collected on the main thread
+    // scripts have to come with the revision the other clients are at
+    SDL_LockMutex(queueMut);
+    resyncPending = true;
+    SDL_UnlockMutex(queueMut);
+    requestResync();
 }
 
 void OFS_WebsocketClient::InitializeConnection(mg_connection* conn) noexcept
 {
     if(this->conn) return;
     this->conn = conn;
+    writerThread = SDL_CreateThread(writerLoop, "WebsocketClientWriter", this);
+    connected = true;
+
     /* Send "hello" message. */
-	const char* hello = "{\"connected\":\"OFS " OFS_LATEST_GIT_TAG "@" OFS_LATEST_GIT_HASH "\"}";
-	mg_websocket_write(conn, MG_WEBSOCKET_OPCODE_TEXT, hello, strlen(hello));
+    nlohmann::json hello = { { "connected", "OFS " OFS_LATEST_GIT_TAG "@" OFS_LATEST_GIT_HASH } };
+    sendJson(hello);
     UpdateAll();
 }
 
 void OFS_WebsocketClient::ReceiveText(char* data, size_t dataLen) noexcept
 {
     // NOTE: Assume this function isn't called on the main thread.
-    bool succ;
+    if(dataLen > MaxReceivedBytes) return;
     std::string_view dataView(data, dataLen);
     auto json = nlohmann::json::parse(dataView, nullptr, false, true);
     if(!json.is_discarded())
     {
-        // Valid json
-        if(CommandBuffer.AddCmd(json))
+        receiveCommand(json);
+    }
+}
+
+void OFS_WebsocketClient::ReceiveBinary(char* data, size_t dataLen) noexcept
+{
+    // NOTE: Assume this function isn't called on the main thread.
+    if(dataLen > MaxReceivedBytes) return;
+    auto begin = (const uint8_t*)data;
+    // from_cbor recurses once per nesting level, a deeply nested message would overflow the stack
+    // this pass only counts the depth and stops before it gets that far
+    CborDepthLimit depthLimit(MaxReceivedDepth);
+    if(!nlohmann::json::sax_parse(begin, begin + dataLen, &depthLimit, nlohmann::json::input_format_t::cbor, true)) return;
+    auto json = nlohmann::json::from_cbor(begin, begin + dataLen, true, false);
+    if(!json.is_discarded())
+    {
+        receiveCommand(json);
+    }
+}
+
+void OFS_WebsocketClient::receiveCommand(const nlohmann::json& json) noexcept
+{
+    // Valid json, the same commands are accepted as text & CBOR
+    nlohmann::json response;
+    if(handleClientCommand(json) || CommandBuffer.AddCmd(json, id))
+    {
+        // Success
+    }
+    else if(CommandBuffer.RunQuery(json, response))
+    {
+        // answered right here on the connection's thread
+        sendJson(response);
+    }
+}
+
+bool OFS_WebsocketClient::handleClientCommand(const nlohmann::json& json) noexcept
+{
+    // commands which only change this connection
+    auto type = json.find("type");
+    auto name = json.find("name");
+    auto data = json.find("data");
+    if(type == json.end() || *type != "command" || name == json.end() || data == json.end()) return false;
+
+    if(*name == "funscript_updates")
+    {
+        auto mode = data->find("mode");
+        if(mode == data->end() || !mode->is_string()) return false;
+        bool delta = *mode == "delta";
+        if(!delta && *mode != "full") return false;
+        if(deltaUpdates.exchange(delta) != delta)
         {
-            // Success
+            SDL_AtomicAdd(&deltaClientCount, delta ? 1 : -1);
         }
+        return true;
     }
-}
\ No newline at end of file
+    else if(*name == "clock_subscribe")
+    {
+        // samples per second, 0 stops them
+        auto rate = data->find("rate");
+        if(rate == data->end() || !rate->is_number()) return false;
+        double hz = rate->get<double>();
+        if(!std::isfinite(hz)) return false;
+        // clamped before converting, the value comes straight from the client
+        hz = std::clamp(hz, 0.0, (double)OFS_WebsocketClock::MaxRate);
+        Clock.Subscribe(this, binary, (int)std::ceil(hz));
+        return true;
+    }
+    return false;
+}
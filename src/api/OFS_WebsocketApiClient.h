@@ -2,32 +2,98 @@
 #include "OFS_EventSystem.h"
 #include "OFS_WebsocketApiEvents.h"
 #include "OFS_WebsocketApiCommands.h"
+#include "OFS_WebsocketApiClock.h"
 
 #include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <atomic>
+
+#include "SDL_thread.h"
+#include "SDL_mutex.h"
 
 // This event is pushed to the internal websocket clients and not part of the API
 class WsSerializedEvent : public OFS_Event<WsSerializedEvent>
 {
     public:
+    // only filled if clients using that subprotocol are connected
     std::string serializedEvent;
-    WsSerializedEvent(std::string&& json) noexcept
-        : serializedEvent(std::move(json)) {}
+    std::vector<uint8_t> serializedCBOR;
+    WsTarget target;
+    // non zero for events where only the latest one matters, equal keys replace each other in the send queues
+    uint32_t coalesceKey = 0;
+    // time updates & clock samples, a full send queue drops these first without needing a resync
+    // the next one makes up for it, unlike a missed pause or media change
+    bool evictable = false;
+    WsSerializedEvent(std::string&& json, std::vector<uint8_t>&& cbor, WsTarget target, uint32_t coalesceKey = 0, bool evictable = false) noexcept
+        : serializedEvent(std::move(json)), serializedCBOR(std::move(cbor)), target(target), coalesceKey(coalesceKey), evictable(evictable) {}
 };
 
+// Every client has its own bounded send queue and writer thread,
+// a slow connection only ever stalls its own writer.
 class OFS_WebsocketClient
 {
     private:
+    static constexpr size_t MaxQueuedMessages = 256;
+    static constexpr size_t MaxQueuedBytes = 64 * 1024 * 1024;
+    // commands are tiny, anything bigger is rejected before parsing
+    static constexpr size_t MaxReceivedBytes = 1024 * 1024;
+    // the CBOR parser recurses for every nested array/object
+    static constexpr uint32_t MaxReceivedDepth = 64;
+
     UnsubscribeFn eventUnsub;
 	struct mg_connection* conn = nullptr;
+    uint32_t id = 0;
+    // ofs-api.cbor, messages are sent & received as binary CBOR
+    bool binary = false;
+    // funscript_delta instead of funscript_change for script updates
+    std::atomic<bool> deltaUpdates = false;
+
+    static SDL_atomic_t nextClientId;
+    static SDL_atomic_t deltaClientCount;
+    static SDL_atomic_t textClientCount;
+    static SDL_atomic_t binaryClientCount;
 
-    void handleSerializedEvent(const WsSerializedEvent* ev) noexcept;
+    // guarded by queueMut
+    SDL_mutex* queueMut = nullptr;
+    SDL_cond* queueCond = nullptr;
+    std::deque<std::shared_ptr<const WsSerializedEvent>> sendQueue;
+    size_t queuedBytes = 0;
+    bool stopWriter = false;
+    // set from requesting a resync until its last message is queued
+    // overflows inbetween don't request another one right away, the resync itself may be what overflowed
+    bool resyncPending = false;
+    // the resync lost some of its own messages, another one follows once it's done
+    bool overflowedDuringResync = false;
+
+    SDL_Thread* writerThread = nullptr;
+    std::atomic<bool> connected = false;
+    std::atomic<uint32_t> droppedMessages = 0;
+    std::atomic<uint32_t> droppedResyncs = 0;
+
+    static int writerLoop(void* user) noexcept;
+    void handleSerializedEvent(const std::shared_ptr<const WsSerializedEvent>& ev) noexcept;
     void handleProjectChange(const WsProjectChange* ev) noexcept;
-    void sendMessage(const std::string& msg) noexcept;
+    // never blocks on the connection
+    void sendMessage(std::shared_ptr<const WsSerializedEvent>&& msg) noexcept;
+    void sendJson(const nlohmann::json& json) noexcept;
+    size_t payloadSize(const WsSerializedEvent& msg) const noexcept;
+    void requestResync() noexcept;
+    void receiveCommand(const nlohmann::json& json) noexcept;
+    bool handleClientCommand(const nlohmann::json& json) noexcept;
     
     public:
     static WsCommandBuffer CommandBuffer;
+    static OFS_WebsocketClock Clock;
+
+    // number of clients which asked for delta updates
+    static inline int DeltaClients() noexcept { return SDL_AtomicGet(&deltaClientCount); }
+    // number of clients using ofs-api.json & ofs-api.cbor
+    static inline int TextClients() noexcept { return SDL_AtomicGet(&textClientCount); }
+    static inline int BinaryClients() noexcept { return SDL_AtomicGet(&binaryClientCount); }
 
-    OFS_WebsocketClient() noexcept;
+    OFS_WebsocketClient(bool binary) noexcept;
     OFS_WebsocketClient(const OFS_WebsocketClient&) = delete;
     OFS_WebsocketClient(OFS_WebsocketClient&&) = delete;
     ~OFS_WebsocketClient() noexcept;
@@ -35,4 +101,7 @@ class OFS_WebsocketClient
     void InitializeConnection(struct mg_connection* conn) noexcept;
     void UpdateAll() noexcept;
     void ReceiveText(char* data, size_t dateLen) noexcept;
+    void ReceiveBinary(char* data, size_t dataLen) noexcept;
+    // NOTE: called by the clock thread
+    inline void SendClock(std::shared_ptr<const WsSerializedEvent> msg) noexcept { sendMessage(std::move(msg)); }
 };
\ No newline at end of file
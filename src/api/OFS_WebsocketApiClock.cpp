@@ -0,0 +1,157 @@
+#include "OFS_WebsocketApiClock.h"
+#include "OFS_WebsocketApiClient.h"
+#include "OFS_WebsocketApiEvents.h"
+
+#include "OFS_EventSystem.h"
+#include "OFS_Profiling.h"
+#include "OFS_Util.h"
+
+#include "SDL_timer.h"
+
+#include <algorithm>
+#include <limits>
+
+inline static uint64_t toMicroseconds(uint64_t counter, uint64_t frequency) noexcept
+{
+    // counter * 1'000'000 would overflow after a few hours with a nanosecond counter
+    return (counter / frequency) * 1'000'000 + (counter % frequency) * 1'000'000 / frequency;
+}
+
+OFS_WebsocketClock::OFS_WebsocketClock() noexcept
+{
+    mut = SDL_CreateMutex();
+    cond = SDL_CreateCond();
+}
+
+OFS_WebsocketClock::~OFS_WebsocketClock() noexcept
+{
+    Stop();
+    SDL_DestroyCond(cond);
+    SDL_DestroyMutex(mut);
+}
+
+void OFS_WebsocketClock::Start() noexcept
+{
+    if(thread) return;
+    stop = false;
+    thread = SDL_CreateThread(clockLoop, "WebsocketClock", this);
+}
+
+void OFS_WebsocketClock::Stop() noexcept
+{
+    if(!thread) return;
+    SDL_LockMutex(mut);
+    stop = true;
+    SDL_CondSignal(cond);
+    SDL_UnlockMutex(mut);
+    SDL_WaitThread(thread, nullptr);
+    thread = nullptr;
+}
+
+void OFS_WebsocketClock::Publish(const OFS_PlayerClock& playerClock) noexcept
+{
+    SDL_LockMutex(mut);
+    clock = playerClock;
+    SDL_UnlockMutex(mut);
+}
+
+void OFS_WebsocketClock::Subscribe(OFS_WebsocketClient* client, bool binary, int rate) noexcept
+{
+    if(rate <= 0)
+    {
+        Unsubscribe(client);
+        return;
+    }
+    rate = std::min(rate, MaxRate);
+
+    SDL_LockMutex(mut);
+    auto it = std::find_if(subscribers.begin(), subscribers.end(),
+        [client](auto& sub) noexcept { return sub.client == client; });
+    auto& sub = it != subscribers.end() ? *it : subscribers.emplace_back();
+    sub.client = client;
+    sub.binary = binary;
+    sub.interval = SDL_GetPerformanceFrequency() / rate;
+    // the first sample goes out right away
+    sub.next = SDL_GetPerformanceCounter();
+    SDL_CondSignal(cond);
+    SDL_UnlockMutex(mut);
+}
+
+void OFS_WebsocketClock::Unsubscribe(OFS_WebsocketClient* client) noexcept
+{
+    // once this returns the clock thread doesn't touch the client anymore
+    SDL_LockMutex(mut);
+    subscribers.erase(std::remove_if(subscribers.begin(), subscribers.end(),
+        [client](auto& sub) noexcept { return sub.client == client; }), subscribers.end());
+    SDL_UnlockMutex(mut);
+}
+
+uint64_t OFS_WebsocketClock::sendDue(uint64_t now) noexcept
+{
+    OFS_PROFILE(__FUNCTION__);
+    // waking up early by less than a millisecond is fine, every sample carries its own timestamp
+    const uint64_t frequency = SDL_GetPerformanceFrequency();
+    const uint64_t slack = frequency / 1000;
+    bool textDue = false;
+    bool binaryDue = false;
+    for(auto& sub : subscribers)
+    {
+        if((int64_t)(sub.next - now) >= (int64_t)slack) continue;
+        textDue = textDue || !sub.binary;
+        binaryDue = binaryDue || sub.binary;
+    }
+
+    if(textDue || binaryDue)
+    {
+        // serialized once for all clients which are due
+        WsClock sample(clock.TimeAt(now), toMicroseconds(now, frequency), clock.speed, clock.paused);
+        std::string jsonText;
+        std::vector<uint8_t> cbor;
+        if(textDue) sample.SerializeText(jsonText);
+        if(binaryDue) sample.SerializeCBOR(cbor);
+        auto msg = EV::MakeTyped<WsSerializedEvent>(std::move(jsonText), std::move(cbor), WsTarget(), CoalesceKey, true);
+
+        for(auto& sub : subscribers)
+        {
+            if((int64_t)(sub.next - now) >= (int64_t)slack) continue;
+            sub.client->SendClock(msg);
+            sub.next += sub.interval;
+            // fell behind, don't try to catch up with a burst
+            if((int64_t)(sub.next - now) <= 0) sub.next = now + sub.interval;
+        }
+    }
+
+    uint64_t earliest = std::numeric_limits<uint64_t>::max();
+    for(auto& sub : subscribers)
+    {
+        earliest = std::min(earliest, sub.next);
+    }
+    return earliest;
+}
+
+int OFS_WebsocketClock::clockLoop(void* user) noexcept
+{
+    auto ctx = static_cast<OFS_WebsocketClock*>(user);
+    const uint64_t frequency = SDL_GetPerformanceFrequency();
+    SDL_LockMutex(ctx->mut);
+    while(!ctx->stop)
+    {
+        if(ctx->subscribers.empty())
+        {
+            SDL_CondWait(ctx->cond, ctx->mut);
+            continue;
+        }
+
+        uint64_t now = SDL_GetPerformanceCounter();
+        uint64_t next = ctx->sendDue(now);
+        now = SDL_GetPerformanceCounter();
+        if(next > now)
+        {
+            // Subscribe signals the condition, a new client may be due earlier
+            uint32_t waitMs = (uint32_t)((next - now) * 1000 / frequency);
+            if(waitMs > 0) SDL_CondWaitTimeout(ctx->cond, ctx->mut, waitMs);
+        }
+    }
+    SDL_UnlockMutex(ctx->mut);
+    return 0;
+}
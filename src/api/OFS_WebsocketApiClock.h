@@ -0,0 +1,56 @@
+#pragma once
+
+#include "OFS_Videoplayer.h"
+
+#include <vector>
+#include <cstdint>
+
+#include "SDL_thread.h"
+#include "SDL_mutex.h"
+
+// Sends the playback clock to clients which subscribed with clock_subscribe.
+// The main thread publishes the player's clock every frame, a dedicated thread extrapolates it
+// to the moment a client is due and sends it with the server time of that moment.
+// Clients map the server time onto their own clock and interpolate inbetween samples.
+class OFS_WebsocketClock
+{
+    private:
+    struct Subscriber
+    {
+        class OFS_WebsocketClient* client = nullptr;
+        bool binary = false;
+        uint64_t interval = 0; // performance counter ticks
+        uint64_t next = 0;
+    };
+
+    // guarded by mut
+    SDL_mutex* mut = nullptr;
+    SDL_cond* cond = nullptr;
+    std::vector<Subscriber> subscribers;
+    OFS_PlayerClock clock;
+    bool stop = false;
+
+    SDL_Thread* thread = nullptr;
+
+    static int clockLoop(void* user) noexcept;
+    // sends to everyone who is due, returns the earliest time someone is due next
+    uint64_t sendDue(uint64_t now) noexcept;
+
+    public:
+    static constexpr int MaxRate = 1000;
+    // outside the range of WsEvent indices, only the newest sample stays in a send queue
+    static constexpr uint32_t CoalesceKey = 0x10000;
+
+    OFS_WebsocketClock() noexcept;
+    OFS_WebsocketClock(const OFS_WebsocketClock&) = delete;
+    ~OFS_WebsocketClock() noexcept;
+
+    void Start() noexcept;
+    void Stop() noexcept;
+
+    // called every frame by the main thread
+    void Publish(const OFS_PlayerClock& playerClock) noexcept;
+    // rate in Hz, 0 unsubscribes
+    void Subscribe(class OFS_WebsocketClient* client, bool binary, int rate) noexcept;
+    void Unsubscribe(class OFS_WebsocketClient* client) noexcept;
+};
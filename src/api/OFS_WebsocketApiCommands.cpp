@@ -1,63 +1,324 @@
 #include "OFS_WebsocketApiCommands.h"
+#include "OFS_Profiling.h"
+#include "FunscriptSpline.h"
+#include "FunscriptHeatmap.h"
+
 #include <optional>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <array>
+#include <type_traits>
 
 WsCommandBuffer::WsCommandBuffer() noexcept
 {
+    batch.reserve(QueueCapacity);
+}
 
+inline static std::optional<float> optionalNumber(const nlohmann::json& data, const char* key) noexcept
+{
+    auto it = data.find(key);
+    if(it == data.end() || !it->is_number()) return {};
+    // converting doubles outside the float range is undefined, they end up as NaN for the callers to reject
+    double value = it->get<double>();
+    if(!(std::abs(value) <= std::numeric_limits<float>::max())) return std::numeric_limits<float>::quiet_NaN();
+    return (float)value;
 }
 
-inline static std::unique_ptr<WsCmd> CreateCommand(const std::string& name, const nlohmann::json& data) noexcept
+inline static WsCommand CreateCommand(const std::string& name, const nlohmann::json& data, uint32_t clientId) noexcept
 {
-    if(name == "change_time" && data["time"].is_number())
+    auto value = [&data](const char* key) noexcept -> const nlohmann::json*
+    {
+        auto it = data.find(key);
+        return it != data.end() ? &*it : nullptr;
+    };
+
+    if(name == "change_time")
+    {
+        // NaN & infinity can come straight from CBOR clients
+        auto time = optionalNumber(data, "time");
+        if(time && std::isfinite(*time) && *time >= 0.f) return WsTimeChangeCmd(*time);
+    }
+    else if(name == "change_play")
     {
-        float time = data["time"].get<float>();
-        return std::make_unique<WsTimeChangeCmd>(time);
+        auto playing = value("playing");
+        if(playing && playing->is_boolean()) return WsPlayChangeCmd(playing->get<bool>());
     }
-    else if(name == "change_play" && data["playing"].is_boolean())
+    else if(name == "change_playbackspeed")
     {
-        bool playing = data["playing"].get<bool>();
-        return std::make_unique<WsPlayChangeCmd>(playing);
+        auto speed = optionalNumber(data, "speed");
+        if(speed && std::isfinite(*speed) && *speed >= 0.f) return WsPlaybackSpeedChangeCmd(*speed);
     }
-    else if(name == "change_playbackspeed" && data["speed"].is_number())
+    else if(name == "funscript_resync")
     {
-        float speed = data["speed"].get<float>();
-        return std::make_unique<WsPlaybackSpeedChangeCmd>(speed);
+        // name is optional
+        auto scriptName = value("name");
+        return WsFunscriptResyncCmd(clientId,
+            scriptName && scriptName->is_string() ? scriptName->get<std::string>() : std::string());
     }
     return {};
 }
 
-bool WsCommandBuffer::AddCmd(const nlohmann::json& jsonCmd) noexcept
+bool WsCommandBuffer::AddCmd(const nlohmann::json& jsonCmd, uint32_t clientId) noexcept
 {
-    auto& type = jsonCmd["type"];
-    if(!type.is_string() || type != "command") return false;
+    auto type = jsonCmd.find("type");
+    if(type == jsonCmd.end() || !type->is_string() || *type != "command") return false;
+
+    auto name = jsonCmd.find("name");
+    if(name == jsonCmd.end() || !name->is_string()) return false;
 
-    auto& name = jsonCmd["name"];
-    if(!name.is_string()) return false;
+    auto data = jsonCmd.find("data");
+    if(data == jsonCmd.end() || !data->is_object()) return false;
 
-    auto& data = jsonCmd["data"];
-    if(data.is_null()) return false;
+    auto cmd = CreateCommand(name->get_ref<const std::string&>(), *data, clientId);
+    if(std::holds_alternative<std::monostate>(cmd)) return false;
+    AddCmd(std::move(cmd));
+    return true;
+}
 
-    auto cmd = CreateCommand(name.get_ref<const std::string&>(), data);
-    if(cmd)
+bool WsCommandBuffer::AddCmd(WsCommand&& cmd) noexcept
+{
+    if(!commands.try_push(std::move(cmd)))
     {
-        SDL_AtomicLock(&commandLock);
-        commands.emplace_back(std::move(cmd));
-        SDL_AtomicUnlock(&commandLock);
-        return true;
+        // only happens if the main thread doesn't get to ProcessCommands
+        LOG_WARN("Websocket command queue is full, dropped a command.");
+        return false;
     }
-    return false;
+    return true;
+}
+
+// clients which are scrubbing send seeks a lot faster than frames are rendered
+// only the position & speed at the end of a frame matter
+inline static bool isLatestWins(const WsCommand& cmd) noexcept
+{
+    return std::holds_alternative<WsTimeChangeCmd>(cmd)
+        || std::holds_alternative<WsPlaybackSpeedChangeCmd>(cmd);
 }
 
 void WsCommandBuffer::ProcessCommands() noexcept
 {
     if(commands.empty()) return;
-    SDL_AtomicLock(&commandLock);
-    for(auto& cmd : commands)
+    OFS_PROFILE(__FUNCTION__);
+    batch.clear();
+    commands.pop_all(batch);
+
+    std::array<size_t, std::variant_size_v<WsCommand>> lastOfType;
+    lastOfType.fill(batch.size());
+    for(size_t i=0; i < batch.size(); i += 1)
+    {
+        lastOfType[batch[i].index()] = i;
+    }
+
+    for(size_t i=0; i < batch.size(); i += 1)
+    {
+        auto& cmd = batch[i];
+        if(isLatestWins(cmd) && lastOfType[cmd.index()] != i) continue;
+        std::visit([](auto& command) noexcept
+        {
+            if constexpr (!std::is_same_v<std::decay_t<decltype(command)>, std::monostate>) command.Run();
+        }, cmd);
+    }
+    batch.clear();
+}
+
+void WsCommandBuffer::PublishSnapshot(const std::string& name, std::shared_ptr<const WsScriptSnapshot> snapshot) noexcept
+{
+    SDL_AtomicLock(&snapshotLock);
+    auto it = std::find_if(snapshots.begin(), snapshots.end(),
+        [&name](auto& named) noexcept { return named.name == name; });
+    if(it != snapshots.end())
+    {
+        // the old one stays alive until running queries are done with it
+        std::swap(it->snapshot, snapshot);
+    }
+    else
+    {
+        snapshots.push_back({ name, std::move(snapshot) });
+    }
+    SDL_AtomicUnlock(&snapshotLock);
+}
+
+void WsCommandBuffer::RemoveSnapshot(const std::string& name) noexcept
+{
+    std::shared_ptr<const WsScriptSnapshot> removed;
+    SDL_AtomicLock(&snapshotLock);
+    auto it = std::find_if(snapshots.begin(), snapshots.end(),
+        [&name](auto& named) noexcept { return named.name == name; });
+    if(it != snapshots.end())
+    {
+        removed = std::move(it->snapshot);
+        snapshots.erase(it);
+    }
+    SDL_AtomicUnlock(&snapshotLock);
+}
+
+void WsCommandBuffer::ClearSnapshots() noexcept
+{
+    std::vector<NamedSnapshot> cleared;
+    SDL_AtomicLock(&snapshotLock);
+    std::swap(cleared, snapshots);
+    SDL_AtomicUnlock(&snapshotLock);
+}
+
+std::shared_ptr<const WsScriptSnapshot> WsCommandBuffer::findSnapshot(const std::string& name) noexcept
+{
+    std::shared_ptr<const WsScriptSnapshot> snapshot;
+    SDL_AtomicLock(&snapshotLock);
+    auto it = std::find_if(snapshots.begin(), snapshots.end(),
+        [&name](auto& named) noexcept { return named.name == name; });
+    if(it != snapshots.end()) snapshot = it->snapshot;
+    SDL_AtomicUnlock(&snapshotLock);
+    return snapshot;
+}
+
+inline static int64_t toMilliseconds(float atS) noexcept
+{
+    // same rounding as Funscript::Serialize
+    return (int64_t)std::round(atS * 1000.0);
+}
+
+// floats are widened to doubles in the json, without rounding 0.02 becomes 0.019999999552965164
+inline static nlohmann::json roundedArray(const std::vector<float>& values, double scale) noexcept
+{
+    auto array = nlohmann::json::array();
+    array.get_ref<nlohmann::json::array_t&>().reserve(values.size());
+    for(float value : values)
+    {
+        array.push_back(std::round(value * scale) / scale);
+    }
+    return array;
+}
+
+// every query returns nullptr on success or an error message for the client
+
+inline static const char* queryActions(const nlohmann::json& data, const WsScriptSnapshot& snapshot, nlohmann::json& result) noexcept
+{
+    float from = optionalNumber(data, "from").value_or(0.f);
+    float to = optionalNumber(data, "to").value_or(std::numeric_limits<float>::max());
+    // also false for NaN, which would break the ordering lower_bound relies on
+    if(!(from <= to)) return "to is before from";
+
+    auto actions = nlohmann::json::array();
+    auto begin = snapshot.actions.lower_bound(FunscriptAction(from, 0));
+    auto end = snapshot.actions.upper_bound(FunscriptAction(to, 0));
+    for(auto it = begin; it != end; ++it)
+    {
+        actions.push_back({ { "at", toMilliseconds(it->atS) }, { "pos", Util::Clamp<int32_t>(it->pos, 0, 100) } });
+    }
+    result["actions"] = std::move(actions);
+    return nullptr;
+}
+
+inline static const char* querySample(const nlohmann::json& data, const WsScriptSnapshot& snapshot, nlohmann::json& result) noexcept
+{
+    auto from = optionalNumber(data, "from");
+    auto to = optionalNumber(data, "to");
+    auto rate = optionalNumber(data, "rate");
+    if(!from || !to || !rate) return "from, to and rate are required";
+    // CBOR clients can send NaN & infinity directly
+    if(!std::isfinite(*from) || !std::isfinite(*to) || !std::isfinite(*rate)) return "from, to and rate have to be finite";
+    if(*to < *from || *rate <= 0.f) return "invalid window or rate";
+
+    bool spline = false;
+    auto interpolation = data.find("interpolation");
+    if(interpolation != data.end())
+    {
+        if(*interpolation == "spline") spline = true;
+        else if(*interpolation != "linear") return "interpolation has to be linear or spline";
+    }
+
+    double count = std::floor(((double)*to - (double)*from) * *rate) + 1.0;
+    // written so NaN fails as well
+    if(!(count <= WsCommandBuffer::MaxQuerySamples)) return "too many samples";
+
+    float stepTime = 1.f / *rate;
+    if(!std::isfinite(stepTime)) return "invalid window or rate";
+    auto& actions = snapshot.actions;
+    std::vector<float> positions((size_t)count);
+    if(actions.empty())
+    {
+        std::fill(positions.begin(), positions.end(), 0.f);
+    }
+    else if(spline)
+    {
+        FunscriptSpline::SampleRange(actions, *from, stepTime, positions.size(), positions.data());
+        // same 0-100 range as linear
+        for(auto& pos : positions) pos *= 100.f;
+    }
+    else 
     {
-        cmd->Run();
+        // same as Funscript::SampleRange
+        FunscriptActionSoA soa;
+        soa.LoadRange(actions, *from, *from + (float)(positions.size() - 1) * stepTime, 0);
+        float lastPos = actions.back().pos;
+        FunscriptActionKernels::SampleLinear(soa, *from, stepTime, positions.data(), positions.size(), lastPos, lastPos);
     }
-    commands.clear();
-    SDL_AtomicUnlock(&commandLock);
+    result["from"] = *from;
+    result["rate"] = *rate;
+    result["interpolation"] = spline ? "spline" : "linear";
+    result["positions"] = roundedArray(positions, 100.0);
+    return nullptr;
+}
+
+inline static const char* queryHeatmap(const nlohmann::json& data, const WsScriptSnapshot& snapshot, float mediaDuration, nlohmann::json& result) noexcept
+{
+    auto bins = optionalNumber(data, "bins").value_or(256.f);
+    // written so NaN fails as well
+    if(!(bins >= 1.f && bins <= FunscriptHeatmap::MaxResolution)) return "bins has to be between 1 and 4096";
+
+    // without a video the heatmap spans the script
+    float duration = mediaDuration > 0.f || snapshot.actions.empty() ? mediaDuration : snapshot.actions.back().atS;
+    result["duration"] = duration;
+    result["max_speed"] = FunscriptHeatmap::MaxSpeedPerSecond;
+    result["speeds"] = roundedArray(FunscriptHeatmap::SpeedBins(duration, snapshot.actions, (uint32_t)bins), 10000.0);
+    return nullptr;
+}
+
+bool WsCommandBuffer::RunQuery(const nlohmann::json& jsonCmd, nlohmann::json& response) noexcept
+{
+    // NOTE: this is not called by the main thread
+    OFS_PROFILE(__FUNCTION__);
+    auto type = jsonCmd.find("type");
+    auto name = jsonCmd.find("name");
+    if(type == jsonCmd.end() || *type != "command" || name == jsonCmd.end() || !name->is_string()) return false;
+    auto& queryName = name->get_ref<const std::string&>();
+    if(queryName != "funscript_actions" && queryName != "funscript_sample" && queryName != "funscript_heatmap") return false;
+
+    response = { { "type", "response" }, { "name", queryName } };
+    // lets clients match responses to their requests
+    auto id = jsonCmd.find("id");
+    if(id != jsonCmd.end()) response["id"] = *id;
+
+    auto data = jsonCmd.find("data");
+    const nlohmann::json* scriptName = nullptr;
+    if(data != jsonCmd.end() && data->is_object())
+    {
+        auto it = data->find("name");
+        if(it != data->end() && it->is_string()) scriptName = &*it;
+    }
+    if(!scriptName)
+    {
+        response["error"] = "the script name is missing";
+        return true;
+    }
+
+    // the script can change while the query runs, the snapshot stays the same
+    auto snapshot = findSnapshot(scriptName->get_ref<const std::string&>());
+    if(!snapshot)
+    {
+        response["error"] = "unknown script";
+        return true;
+    }
+
+    nlohmann::json result = { { "name", *scriptName }, { "revision", snapshot->revision } };
+    const char* error = nullptr;
+    if(queryName == "funscript_actions") error = queryActions(*data, *snapshot, result);
+    else if(queryName == "funscript_sample") error = querySample(*data, *snapshot, result);
+    else error = queryHeatmap(*data, *snapshot, mediaDuration, result);
+
+    if(error) response["error"] = error;
+    else response["data"] = std::move(result);
+    return true;
 }
 
 
@@ -79,4 +340,16 @@ void WsTimeChangeCmd::Run() noexcept
 {
     auto app = OpenFunscripter::ptr;
     app->player->SetPositionExact(time);
-}
\ No newline at end of file
+}
+
+void WsFunscriptResyncCmd::Run() noexcept
+{
+    auto app = OpenFunscripter::ptr;
+    app->webApi->ResyncScripts(clientId, name);
+}
+
+void WsClientResyncCmd::Run() noexcept
+{
+    auto app = OpenFunscripter::ptr;
+    app->webApi->ResyncClient(clientId);
+}
@@ -3,54 +3,122 @@
 #include <vector>
 #include <variant>
 #include <memory>
+#include <string>
+#include <atomic>
 
 #include "SDL_atomic.h"
 #include "OFS_Util.h"
+#include "OFS_MPSCQueue.h"
+#include "FunscriptAction.h"
 
-class WsCmd 
-{
-    public:
-    virtual void Run() noexcept = 0;
-};
-
-class WsPlayChangeCmd : public WsCmd
+// Commands are stored by value in a fixed size queue.
+// Only a resync for a script with a long name allocates, seeking & co. never do.
+// Run is called by the main thread.
+class WsPlayChangeCmd
 {
     public:
     bool playing = false;
     WsPlayChangeCmd(bool playing) noexcept
         : playing(playing) {}
     
-    void Run() noexcept override;
+    void Run() noexcept;
 };
 
-class WsPlaybackSpeedChangeCmd : public WsCmd
+class WsPlaybackSpeedChangeCmd
 {
     public:
     float speed = 1.f;
     WsPlaybackSpeedChangeCmd(float speed) noexcept
         : speed(speed) {}
 
-    void Run() noexcept override;
+    void Run() noexcept;
 };
 
-class WsTimeChangeCmd : public WsCmd
+class WsTimeChangeCmd
 {
     public:
     float time = 0.f;
     WsTimeChangeCmd(float time) noexcept
         : time(time) {}
 
-    void Run() noexcept override;
+    void Run() noexcept;
+};
+
+// Sends the scripts as full funscript_change to a single client.
+// Clients ask for this when a funscript_delta doesn't apply to the revision they have.
+class WsFunscriptResyncCmd
+{
+    public:
+    uint32_t clientId = 0;
+    std::string name; // all scripts if empty
+    WsFunscriptResyncCmd(uint32_t clientId, std::string name) noexcept
+        : clientId(clientId), name(std::move(name)) {}
+
+    void Run() noexcept;
+};
+
+// Sends the player state and all scripts to a single client.
+// Used for new connections and clients which fell too far behind.
+class WsClientResyncCmd
+{
+    public:
+    uint32_t clientId = 0;
+    WsClientResyncCmd(uint32_t clientId) noexcept
+        : clientId(clientId) {}
+
+    void Run() noexcept;
+};
+
+using WsCommand = std::variant<std::monostate, WsPlayChangeCmd, WsPlaybackSpeedChangeCmd, WsTimeChangeCmd,
+    WsFunscriptResyncCmd, WsClientResyncCmd>;
+
+// A script as the clients have it at revision, never modified once published.
+// Queries are answered from these without touching the main thread.
+struct WsScriptSnapshot
+{
+    uint32_t revision = 0;
+    FunscriptArray actions;
+
+    WsScriptSnapshot(uint32_t revision, const FunscriptArray& actions) noexcept
+        : revision(revision), actions(actions) {}
 };
 
 class WsCommandBuffer
 {
     private:
-    std::vector<std::unique_ptr<WsCmd>> commands;
-    SDL_SpinLock commandLock = {0};
+    static constexpr size_t QueueCapacity = 512;
+    mpsc_queue<WsCommand, QueueCapacity> commands;
+    // only used by ProcessCommands, reused so draining the queue doesn't allocate
+    std::vector<WsCommand> batch;
+
+    struct NamedSnapshot
+    {
+        std::string name;
+        std::shared_ptr<const WsScriptSnapshot> snapshot;
+    };
+    // guarded by snapshotLock, the lock is only held to copy a shared_ptr
+    std::vector<NamedSnapshot> snapshots;
+    SDL_SpinLock snapshotLock = {0};
+    std::atomic<float> mediaDuration = 0.f;
+
+    std::shared_ptr<const WsScriptSnapshot> findSnapshot(const std::string& name) noexcept;
     public:
+    // limit for funscript_sample & funscript_heatmap responses
+    static constexpr size_t MaxQuerySamples = 100'000;
 
     WsCommandBuffer() noexcept;
-    bool AddCmd(const nlohmann::json& jsonCmd) noexcept;
+    bool AddCmd(const nlohmann::json& jsonCmd, uint32_t clientId) noexcept;
+    // safe to call from any thread, returns false if the queue is full
+    bool AddCmd(WsCommand&& cmd) noexcept;
+    // only the last seek & speed change of a batch runs, everything else runs in order
     void ProcessCommands() noexcept;
+
+    // Runs funscript_actions, funscript_sample & funscript_heatmap on the calling thread.
+    // Returns false if jsonCmd isn't a query, otherwise response has the result or an error.
+    bool RunQuery(const nlohmann::json& jsonCmd, nlohmann::json& response) noexcept;
+    // called by the main thread whenever clients get a new revision
+    void PublishSnapshot(const std::string& name, std::shared_ptr<const WsScriptSnapshot> snapshot) noexcept;
+    void RemoveSnapshot(const std::string& name) noexcept;
+    void ClearSnapshots() noexcept;
+    inline void SetMediaDuration(float duration) noexcept { mediaDuration = duration; }
 };
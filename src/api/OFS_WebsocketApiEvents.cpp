@@ -1,4 +1,7 @@
 #include "OFS_WebsocketApiEvents.h"
+#include "OFS_Profiling.h"
+
+#include <cmath>
 
 inline static void initializeEvent(nlohmann::json& j, const char* eventName)
 {
@@ -46,11 +49,95 @@ void to_json(nlohmann::json& j, const WsFunscriptChange& p)
     initializeEvent(j, "funscript_change");
     nlohmann::json funscript;
     Funscript::Serialize(funscript, p.funscriptData, p.funscriptMetadata, true);
-    j["data"] = { { "name", p.name }, { "funscript",  std::move(funscript) } };
+    j["data"] = { { "name", p.name }, { "revision", p.revision }, { "funscript",  std::move(funscript) } };
+}
+
+void WsFunscriptChange::SerializeText(std::string& text) noexcept
+{
+    // same layout as to_json with an empty actions array which gets filled afterwards
+    nlohmann::json j;
+    initializeEvent(j, "funscript_change");
+    nlohmann::json funscript;
+    Funscript::Serialize(funscript, Funscript::FunscriptData(), funscriptMetadata, true);
+    j["data"] = { { "name", name }, { "revision", revision }, { "funscript",  std::move(funscript) } };
+    text = Util::SerializeJson(j);
+    Funscript::InsertActions(text, funscriptData.Actions);
 }
 
 void to_json(nlohmann::json& j, const WsFunscriptRemove& p)
 {
     initializeEvent(j, "funscript_remove");
     j["data"] = { {"name", p.name } };
-}
\ No newline at end of file
+}
+
+void to_json(nlohmann::json& j, const WsClock& p)
+{
+    initializeEvent(j, "clock");
+    j["data"] = { { "time", p.time }, { "wall_us", p.wallUs }, { "speed", p.speed }, { "paused", p.paused } };
+}
+
+inline static int64_t toMilliseconds(float atS) noexcept
+{
+    // same rounding as Funscript::Serialize
+    return (int64_t)std::round(atS * 1000.0);
+}
+
+bool WsFunscriptDelta::Compute(const FunscriptArray& before, const FunscriptArray& after, std::vector<Hunk>& outHunks) noexcept
+{
+    OFS_PROFILE(__FUNCTION__);
+    outHunks.clear();
+    // both are sorted by time, walk them like a merge
+    // and collect everything that differs inbetween equal actions
+    size_t insertedCount = 0;
+    Hunk* hunk = nullptr;
+    auto a = before.begin(), aEnd = before.end();
+    auto b = after.begin(), bEnd = after.end();
+    while (a != aEnd || b != bEnd) {
+        if (a != aEnd && b != bEnd && *a == *b) {
+            hunk = nullptr;
+            ++a; ++b;
+            continue;
+        }
+
+        bool inserted = false;
+        FunscriptAction action;
+        if (b == bEnd || (a != aEnd && a->atS < b->atS)) {
+            // removed
+            action = *a;
+            ++a;
+        }
+        else {
+            // inserted, or modified if the time is the same
+            if (a != aEnd && a->atS == b->atS) ++a;
+            action = *b;
+            inserted = true;
+            ++b;
+        }
+
+        auto ms = toMilliseconds(action.atS);
+        if (!hunk) {
+            hunk = &outHunks.emplace_back();
+            hunk->fromMs = ms;
+        }
+        hunk->toMs = ms;
+        if (inserted) {
+            hunk->actions.emplace_back(action);
+            insertedCount += 1;
+        }
+    }
+    return insertedCount + outHunks.size() <= after.size() / 2;
+}
+
+void to_json(nlohmann::json& j, const WsFunscriptDelta& p)
+{
+    initializeEvent(j, "funscript_delta");
+    auto hunks = nlohmann::json::array();
+    for (auto& hunk : p.hunks) {
+        auto actions = nlohmann::json::array();
+        for (auto& action : hunk.actions) {
+            actions.push_back({ { "at", toMilliseconds(action.atS) }, { "pos", Util::Clamp<int32_t>(action.pos, 0, 100) } });
+        }
+        hunks.push_back({ { "from", hunk.fromMs }, { "to", hunk.toMs }, { "actions", std::move(actions) } });
+    }
+    j["data"] = { { "name", p.name }, { "base_revision", p.baseRevision }, { "revision", p.revision }, { "hunks", std::move(hunks) } };
+}
@@ -6,10 +6,40 @@
 
 #include <memory>
 #include <string>
+#include <vector>
+
+// Which clients an event is sent to. Script updates depend on the update mode a client picked.
+struct WsTarget
+{
+    enum Mode : uint8_t {
+        AllClients,
+        FullUpdateClients, // clients receiving funscript_change for every update
+        DeltaUpdateClients, // clients receiving funscript_delta
+        SingleClient,
+    };
+    Mode mode = AllClients;
+    uint32_t clientId = 0; // only used by SingleClient
+    bool resyncEnd = false; // last message of OFS_WebsocketApi::ResyncClient
+};
 
 struct ToJsonInterface
 {
+    WsTarget target;
+
     virtual void Serialize(nlohmann::json& json) noexcept = 0;
+    virtual void SerializeText(std::string& text) noexcept
+    {
+        nlohmann::json json;
+        Serialize(json);
+        text = Util::SerializeJson(json);
+    }
+    // for clients using the ofs-api.cbor subprotocol, same layout as the json
+    virtual void SerializeCBOR(std::vector<uint8_t>& data) noexcept
+    {
+        nlohmann::json json;
+        Serialize(json);
+        data = Util::SerializeCBOR(json);
+    }
 };
 
 void to_json(nlohmann::json& j, const class WsProjectChange& p);
@@ -20,6 +50,8 @@ void to_json(nlohmann::json& j, const class WsMediaChange& p);
 void to_json(nlohmann::json& j, const class WsPlaybackSpeedChange& p);
 void to_json(nlohmann::json& j, const class WsFunscriptChange& p);
 void to_json(nlohmann::json& j, const class WsFunscriptRemove& p);
+void to_json(nlohmann::json& j, const class WsFunscriptDelta& p);
+void to_json(nlohmann::json& j, const class WsClock& p);
 
 class WsMediaChange : public OFS_Event<WsMediaChange>, public ToJsonInterface
 {
@@ -79,11 +111,14 @@ class WsFunscriptChange : public OFS_Event<WsFunscriptChange>, public ToJsonInte
     std::string name;
     Funscript::FunscriptData funscriptData;
     Funscript::Metadata funscriptMetadata;
+    uint32_t revision = 0;
 
-    WsFunscriptChange(const std::string& name, Funscript::FunscriptData funscriptData, Funscript::Metadata metadata) noexcept
-        : name(name), funscriptData(std::move(funscriptData)), funscriptMetadata(std::move(metadata)) {}
+    WsFunscriptChange(const std::string& name, Funscript::FunscriptData funscriptData, Funscript::Metadata metadata, uint32_t revision) noexcept
+        : name(name), funscriptData(std::move(funscriptData)), funscriptMetadata(std::move(metadata)), revision(revision) {}
 
     void Serialize(nlohmann::json& json) noexcept override { to_json(json, *this); }
+    // the actions are written directly into the text
+    void SerializeText(std::string& text) noexcept override;
 };
 
 class WsProjectChange : public OFS_Event<WsProjectChange>, public ToJsonInterface
@@ -104,3 +139,46 @@ class WsFunscriptRemove : public OFS_Event<WsFunscriptRemove>, public ToJsonInte
     void Serialize(nlohmann::json& json) noexcept override { to_json(json, *this); }
 };
 
+// Changes between two revisions of a script.
+// Every hunk replaces all actions with from <= at <= to (in milliseconds) with its actions.
+// Hunks never overlap and are sorted by time.
+class WsFunscriptDelta : public OFS_Event<WsFunscriptDelta>, public ToJsonInterface
+{
+    public:
+    struct Hunk
+    {
+        int64_t fromMs = 0;
+        int64_t toMs = 0;
+        std::vector<FunscriptAction> actions;
+    };
+
+    std::string name;
+    uint32_t baseRevision = 0;
+    uint32_t revision = 0;
+    std::vector<Hunk> hunks;
+
+    WsFunscriptDelta(const std::string& name, uint32_t baseRevision, uint32_t revision, std::vector<Hunk>&& hunks) noexcept
+        : name(name), baseRevision(baseRevision), revision(revision), hunks(std::move(hunks)) {}
+
+    // returns false if sending the whole script is cheaper than the hunks
+    static bool Compute(const FunscriptArray& before, const FunscriptArray& after, std::vector<Hunk>& outHunks) noexcept;
+
+    void Serialize(nlohmann::json& json) noexcept override { to_json(json, *this); }
+};
+
+
+// A sample of the playback clock, sent at the rate a client asked for with clock_subscribe.
+// wallUs is the server's monotonic clock in microseconds when time was sampled.
+class WsClock : public OFS_Event<WsClock>, public ToJsonInterface
+{
+    public:
+    double time = 0.0;
+    uint64_t wallUs = 0;
+    float speed = 1.f;
+    bool paused = true;
+
+    WsClock(double time, uint64_t wallUs, float speed, bool paused) noexcept
+        : time(time), wallUs(wallUs), speed(speed), paused(paused) {}
+
+    void Serialize(nlohmann::json& json) noexcept override { to_json(json, *this); }
+};
\ No newline at end of file
@@ -0,0 +1,119 @@
+#include "OFS_WebsocketApiLoadTest.h"
+#include "OFS_Util.h"
+#include "OFS_Profiling.h"
+
+#include "civetweb.h"
+#include "imgui.h"
+
+#include "SDL_timer.h"
+
+#include <algorithm>
+
+int OFS_WebsocketLoadTest::dataHandler(struct mg_connection* conn, int opcode, char* data, size_t dataLen, void* user) noexcept
+{
+    auto client = static_cast<SimulatedClient*>(user);
+    uint32_t now = SDL_GetTicks();
+    uint32_t last = client->lastMessageTicks.exchange(now);
+    if(last != 0)
+    {
+        uint32_t gap = now - last;
+        if(gap > client->maxGapMs) client->maxGapMs = gap;
+    }
+    client->messages += 1;
+    client->bytes += dataLen;
+
+    // blocks civetweb's reading thread for this connection, the server's writes pile up
+    if(client->readDelayMs > 0) SDL_Delay(client->readDelayMs);
+    return 1;
+}
+
+void OFS_WebsocketLoadTest::closeHandler(const struct mg_connection* conn, void* user) noexcept
+{
+    auto client = static_cast<SimulatedClient*>(user);
+    client->closed = true;
+}
+
+bool OFS_WebsocketLoadTest::Start(int port, const char* path) noexcept
+{
+    OFS_PROFILE(__FUNCTION__);
+    Stop();
+    char errorBuffer[256] = {0};
+    for(int i=0; i < clientCount; i += 1)
+    {
+        auto& client = clients.emplace_back(std::make_unique<SimulatedClient>());
+        client->readDelayMs = i < slowClientCount ? slowReadDelayMs : 0;
+        client->conn = mg_connect_websocket_client("127.0.0.1", port, 0, errorBuffer, sizeof(errorBuffer),
+            path, NULL, dataHandler, closeHandler, client.get());
+        if(!client->conn)
+        {
+            LOGF_ERROR("Load test client %d failed to connect: %s", i, errorBuffer);
+            clients.pop_back();
+            break;
+        }
+    }
+    startTicks = SDL_GetTicks();
+    LOGF_INFO("Started websocket load test with %d clients.", (int)clients.size());
+    return !clients.empty();
+}
+
+void OFS_WebsocketLoadTest::Stop() noexcept
+{
+    for(auto& client : clients)
+    {
+        mg_close_connection(client->conn);
+    }
+    clients.clear();
+}
+
+void OFS_WebsocketLoadTest::ShowControls(int port, const char* path) noexcept
+{
+    if(!Running())
+    {
+        ImGui::InputInt("Clients", &clientCount);
+        ImGui::InputInt("Slow clients", &slowClientCount);
+        ImGui::InputInt("Slow read delay (ms)", &slowReadDelayMs);
+        clientCount = Util::Clamp(clientCount, 1, 256);
+        slowClientCount = Util::Clamp(slowClientCount, 0, clientCount);
+        slowReadDelayMs = Util::Clamp(slowReadDelayMs, 1, 10000);
+        if(ImGui::Button("Start load test")) Start(port, path);
+        return;
+    }
+
+    if(ImGui::Button("Stop load test"))
+    {
+        Stop();
+        return;
+    }
+
+    struct GroupStats
+    {
+        int clients = 0;
+        int closed = 0;
+        uint64_t messages = 0;
+        uint64_t bytes = 0;
+        uint32_t maxGapMs = 0;
+    };
+    GroupStats fast, slow;
+    for(auto& client : clients)
+    {
+        auto& stats = client->readDelayMs > 0 ? slow : fast;
+        stats.clients += 1;
+        stats.closed += client->closed ? 1 : 0;
+        stats.messages += client->messages;
+        stats.bytes += client->bytes;
+        stats.maxGapMs = std::max(stats.maxGapMs, client->maxGapMs.load());
+    }
+
+    float seconds = std::max(0.001f, (SDL_GetTicks() - startTicks) / 1000.f);
+    auto showGroup = [seconds](const char* name, const GroupStats& stats) noexcept
+    {
+        if(stats.clients == 0) return;
+        ImGui::Text("%s: %d (%d closed) %.1f msg/s %.1f KB/s per client, longest gap %u ms", name,
+            stats.clients, stats.closed,
+            stats.messages / seconds / stats.clients,
+            stats.bytes / 1024.f / seconds / stats.clients,
+            stats.maxGapMs);
+    };
+    showGroup("Fast", fast);
+    showGroup("Slow", slow);
+}
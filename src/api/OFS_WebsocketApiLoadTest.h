@@ -0,0 +1,45 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <cstdint>
+
+// Connects simulated clients to the local websocket server.
+// Slow clients sleep after every message they receive, which fills up the socket
+// and their send queue on the server. The fast clients should keep receiving at full rate.
+class OFS_WebsocketLoadTest
+{
+    private:
+    struct SimulatedClient
+    {
+        struct mg_connection* conn = nullptr;
+        uint32_t readDelayMs = 0;
+        std::atomic<uint64_t> messages = 0;
+        std::atomic<uint64_t> bytes = 0;
+        std::atomic<uint32_t> lastMessageTicks = 0;
+        // longest time between two messages
+        std::atomic<uint32_t> maxGapMs = 0;
+        std::atomic<bool> closed = false;
+    };
+
+    std::vector<std::unique_ptr<SimulatedClient>> clients;
+    uint32_t startTicks = 0;
+    int clientCount = 16;
+    int slowClientCount = 2;
+    int slowReadDelayMs = 50;
+
+    static int dataHandler(struct mg_connection* conn, int opcode, char* data, size_t dataLen, void* user) noexcept;
+    static void closeHandler(const struct mg_connection* conn, void* user) noexcept;
+
+    public:
+    OFS_WebsocketLoadTest() noexcept {}
+    OFS_WebsocketLoadTest(const OFS_WebsocketLoadTest&) = delete;
+    ~OFS_WebsocketLoadTest() noexcept { Stop(); }
+
+    bool Start(int port, const char* path) noexcept;
+    void Stop() noexcept;
+    inline bool Running() const noexcept { return !clients.empty(); }
+
+    void ShowControls(int port, const char* path) noexcept;
+};
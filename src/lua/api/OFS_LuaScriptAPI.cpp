@@ -88,17 +88,22 @@ void LuaFunscript::Commit(sol::this_state L) noexcept
         FunscriptArray selection;
         commit.reserve(actions.size());
         for(auto action : actions) {
-            auto succ = commit.emplace(action.o);
-            if(!succ) {
-                luaL_error(L.lua_state(), "Tried adding multiple actions with the same timestamp.");
-                return;
-            }
+            commit.emplace_back_unsorted(action.o);
             if(action.selected) {
-                selection.emplace(action.o);
+                selection.emplace_back_unsorted(action.o);
             }
         }
+        // sort once instead of inserting every action in order
+        commit.sort();
+        auto duplicate = std::adjacent_find(commit.begin(), commit.end(),
+            [](auto a, auto b) { return a.atS == b.atS; });
+        if(duplicate != commit.end()) {
+            luaL_error(L.lua_state(), "Tried adding multiple actions with the same timestamp.");
+            return;
+        }
+        selection.sort();
         app->undoSystem->Snapshot(StateType::CUSTOM_LUA, script);
-        ref->SetActions(commit);
+        ref->SetActions(std::move(commit));
         ref->SetSelection(selection);
     }
 }
@@ -1,4 +1,5 @@
 #include "OpenFunscripter.h"
+#include "OFS_HeatmapExport.h"
 #include "SDL_main.h"
 
 #include "state/OpenFunscripterState.h"
@@ -6,6 +7,10 @@
 
 int main(int argc, char* argv[])
 {
+    if (OFS_HeatmapExport::IsCli(argc, argv)) {
+        return OFS_HeatmapExport::RunCli(argc, argv);
+    }
+
     OFS_LibState::RegisterAll();
     OpenFunscripterState::RegisterAll();
 
@@ -26,6 +26,9 @@ struct PreferenceState
 	bool forceHwDecoding = false;
 	bool showMetaOnNew = true;
 
+	int32_t undoMemoryBudgetMB = 256;
+	bool undoSpillToDisk = true;
+
 	static inline PreferenceState& State(uint32_t stateHandle) noexcept {
 		return OFS_AppState<PreferenceState>(stateHandle).Get();
 	}
@@ -41,4 +44,6 @@ REFL_TYPE(PreferenceState)
 	REFL_FIELD(framerateLimit)
 	REFL_FIELD(forceHwDecoding)
 	REFL_FIELD(showMetaOnNew)
+	REFL_FIELD(undoMemoryBudgetMB)
+	REFL_FIELD(undoSpillToDisk)
 REFL_END
\ No newline at end of file